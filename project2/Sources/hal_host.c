@@ -0,0 +1,88 @@
+// Host (Linux) backend of hal.h, for testing and profiling the recipe engine
+// off the board. Outputs land in halHost instead of registers and the output
+// compare interrupt is called straight from halRun, one call per period.
+//
+// Build: cc -O2 -Wall -DHOST_BUILD -Iproject2 -o servo_host project2/Sources/main.c project2/Sources/hal_host.c
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "hal.h"
+
+#undef printf // Real printf for the verbose log
+
+HalHost halHost;
+
+// Power-on state after setupLed(): run LED off, the others (active low) off
+void halInit(void) {
+  int verbose = halHost.verbose;
+  memset(&halHost, 0, sizeof(HalHost));
+  halHost.verbose = verbose;
+  halHost.leds = (1 << LED_END) | (1 << LED_NEST) | (1 << LED_BAD);
+}
+
+// Record a duty register write
+void halSetDuty(UINT8 channel, UINT8 duty) {
+  if(channel >= HAL_CHANNELS) return;
+  halHost.duty[channel] = duty;
+  halHost.dutyWrites[channel]++;
+  if(halHost.verbose) printf("%8lu pwm%u = %u\n", halHost.ticks, channel, duty);
+}
+
+// Record a PORTB level, counting only real changes
+void halLed(UINT8 bit, UINT8 level) {
+  UINT8 leds = level ? (UINT8)(halHost.leds | (1 << bit)) : (UINT8)(halHost.leds & ~(1 << bit));
+  if(leds == halHost.leds) return;
+  halHost.leds = leds;
+  halHost.ledChanges++;
+  if(halHost.verbose) printf("%8lu led%u = %u\n", halHost.ticks, bit, level ? 1 : 0);
+}
+
+// Advance the virtual timer to the next compare
+void halTimerNext(void) {
+  halHost.tcnt += TC1_VAL;
+}
+
+// Interrupt finished
+void halTimerAck(void) {
+  halHost.ticks++;
+}
+
+// Low 16 bits of the wall clock in ns, differences are right up to 65 us
+// (the board counts 1 us timer ticks instead)
+UINT16 halStamp(void) {
+  return (UINT16)halNanos();
+}
+
+// Record one serial character
+void halPutChar(INT8 ch) {
+  halHost.serial[halHost.serialBytes % HAL_SERIAL] = ch;
+  halHost.serialBytes++;
+  if(halHost.verbose) putchar(ch == '\r' ? '\n' : ch);
+}
+
+// printf onto the recorded serial port
+int halPrintf(const char* format, ...) {
+  char text[256];
+  va_list args;
+  int n;
+  int i;
+  va_start(args, format);
+  n = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  for(i = 0; i < n && text[i] != 0; i++) halPutChar(text[i]);
+  return n;
+}
+
+// Fire the output compare interrupt ticks times
+void halRun(unsigned long ticks) {
+  while(ticks-- > 0) OC1_isr();
+}
+
+// Monotonic wall clock in ns
+unsigned long long halNanos(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
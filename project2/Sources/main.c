@@ -20,95 +20,46 @@
 
 
 // system includes
-#include <hidef.h>      /* common defines and macros */
 #include <stdio.h>      /* Standard I/O Library */
 
 // project includes
 #include "types.h"
-#include "derivative.h" /* derivative-specific definitions */
+#include "hal.h"        /* board registers, or the host recorder with HOST_BUILD */
 
 #include "servos.h"
 
-// Change this value to change the frequency of the output compare signal.
-// The value is in Hz.
-#define OC_FREQ_HZ    ((UINT16)10)
-
-// Macro definitions for determining the TC1 value for the desired frequency
-// in Hz (OC_FREQ_HZ). The formula is:
-//
-// TC1_VAL = ((Bus Clock Frequency / Prescaler value) / 2) / Desired Freq in Hz
-//
-// Where:
-//        Bus Clock Frequency     = 2 MHz
-//        Prescaler Value         = 2 (Effectively giving us a 1 MHz timer)
-//        2 --> Since we want to toggle the output at half of the period
-//        Desired Frequency in Hz = The value you put in OC_FREQ_HZ
-//
-#define BUS_CLK_FREQ  ((UINT32) 2000000)   
-#define PRESCALE      ((UINT16)  2)         
-#define TC1_VAL       ((UINT16)  (((BUS_CLK_FREQ / PRESCALE) / 2) / OC_FREQ_HZ))
+// Host build (records outputs, runs the timer virtually):
+//   cc -O2 -Wall -DHOST_BUILD -Iproject2 -o servo_host project2/Sources/main.c project2/Sources/hal_host.c
 
 
 #define LED_SERVO 0
-// Global reference to servo structs
-Servo servos[2];
-
-
-// Initializes SCI0 for 8N1, 9600 baud, polled I/O
-// The value for the baud selection registers is determined
-// using the formula:
-//
-// SCI0 Baud Rate = ( 2 MHz Bus Clock ) / ( 16 * SCI0BD[12:0] )
-//--------------------------------------------------------------
-void InitializeSerialPort(void)
-{
-    // Set baud rate to ~9600 (See above formula)
-    SCI0BD = 13;          
-    
-    // 8N1 is default, so we don't have to touch SCI0CR1.
-    // Enable the transmitter and receiver.
-    SCI0CR2_TE = 1;
-    SCI0CR2_RE = 1;
-}
+// With one servo it always drives the LEDs, saying so keeps the compiler from
+// seeing a path where any other servo index reaches the state arrays
+#if SERVO_COUNT == 1
+#define IS_LED_SERVO(servo) 1
+#else
+#define IS_LED_SERVO(servo) ((servo) == LED_SERVO)
+#endif
+// Global state of every servo
+Servos servos;
+
+// Index of the lowest set bit of a nibble, 0 for 0
+const UINT8 lowBit[16] = { 0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0 };
+
+// Longest OC1_isr run seen, in halStamp() units (1 us timer counts on the board)
+UINT16 isrWorst = 0;
+
+// ISR to main code log ring, only the ISR moves logHead and only main code
+// moves logTail. Both count up and wrap at 256, LOG_SIZE divides that
+// Slots are volatile too, so neither side's record accesses move past its
+// logHead or logTail store
+volatile LogRecord logRing[LOG_SIZE];
+volatile UINT8 logHead = 0;
+volatile UINT8 logTail = 0;
+volatile UINT16 logDropped = 0; // Records lost to a full ring
+UINT16 logDroppedShown = 0; // logDropped when last reported
 
 
-// Initializes I/O and timer settings for the demo.
-//--------------------------------------------------------------       
-void InitializeTimer(void)
-{
-  // Set the timer prescaler to %2, since the bus clock is at 2 MHz,
-  // and we want the timer running at 1 MHz
-  TSCR2_PR0 = 1;
-  TSCR2_PR1 = 0;
-  TSCR2_PR2 = 0;
-    
-  // Enable output compare on Channel 1
-  TIOS_IOS1 = 1;
-  
-  // Set up output compare action to toggle Port T, bit 1
-  TCTL2_OM1 = 0;
-  TCTL2_OL1 = 1;
-  
-  // Set up timer compare value
-  TC1 = TC1_VAL;
-  
-  // Clear the Output Compare Interrupt Flag (Channel 1) 
-  TFLG1 = TFLG1_C1F_MASK;
-  
-  // Enable the output compare interrupt on Channel 1;
-  TIE_C1I = 1;  
-  
-  //
-  // Enable the timer
-  // 
-  TSCR1_TEN = 1;
-    
-  //
-  // Enable interrupts via macro provided by hidef.h
-  //
-  EnableInterrupts;
-}
-
 // Output Compare Channel 1 Interrupt Service Routine
 // Refreshes TC1 and clears the interrupt flag.
 //          
@@ -125,231 +76,179 @@ void InitializeTimer(void)
 // file in order for this ISR to be placed in the correct
 // location:
 //		VECTOR ADDRESS 0xFFEC OC1_isr 
+#ifndef HOST_BUILD
 #pragma push
 #pragma CODE_SEG __SHORT_SEG NON_BANKED
+#endif
 //--------------------------------------------------------------       
-void interrupt 9 OC1_isr( void )
+HAL_ISR(9, OC1_isr)
 {
-  TC1     +=  TC1_VAL;
-  if(servos[0].wait > 0) {
-    servos[0].wait--;
-  }
-  
-  if(servos[1].wait > 0) {
-    servos[1].wait--;
-  }
+  UINT16 start = halStamp();
+  UINT16 spent;
+  halTimerNext();
+  // Servos whose wait ends this tick become ready, paused or not
+  servos.now++;
+  servos.ready |= servos.due[servos.now & (DUE_SLOTS - 1)];
+  servos.due[servos.now & (DUE_SLOTS - 1)] = 0;
   nextOp();
-  TFLG1   =   TFLG1_C1F_MASK;
-}
-#pragma pop
-
-
-// This function is called by printf in order to
-// output data. Our implementation will use polled
-// serial I/O on SCI0 to output the character.
-//
-// Remember to call InitializeSerialPort() before using printf!
-//
-// Parameters: character to output
-//--------------------------------------------------------------       
-void TERMIO_PutChar(INT8 ch)
-{
-    // Poll for the last transmit to be complete
-    do
-    {
-      // Nothing  
-    } while (SCI0SR1_TC == 0);
-    
-    // write the data to the output shift register
-    SCI0DRL = ch;
-}
-
-
-// Polls for a character on the serial port.
-//
-// Returns: Received character
-//--------------------------------------------------------------       
-UINT8 GetChar(void)
-{ 
-  // Poll for data
-  do
-  {
-    // Nothing
-  } while(SCI0SR1_RDRF == 0);
-   
-  // Fetch and return data from SCI0
-  return SCI0DRL;
-}
-
-// Preset numbers for setting Duty Period to position
-UINT8 calcMove(UINT8 pos) {
-  switch(pos) {
-    case 1:
-      return 250;
-    case 2:
-      return 245;
-    case 3:
-      return 240;
-    case 4:
-      return 235;
-    case 5:
-      return 230;
-    case 6:
-      return 225;
-    default:
-      (void)printf("Bad move position %u\r\n", pos);
+  halTimerAck();
+  spent = halStamp() - start;
+  if(spent > isrWorst) {
+    isrWorst = spent;
   }
-  return 255;
 }
+#ifndef HOST_BUILD
+#pragma pop
+#endif
+
+
+// Preset duty for each position (index 0 unused), copied into every servo
+// at init and adjusted per servo where its linkage needs it
+const UINT8 defaultDuty[POSITIONS + 1] = { 255, 250, 245, 240, 235, 230, 225 };
+
+// Decoded form of every opcode byte, generated by the preprocessor
+// D<n>(kind, arg, step, wait) makes n entries with arg going up by step
+#define D1(kind, arg, step, wait)  { kind, arg, wait }
+#define D2(kind, arg, step, wait)  D1(kind, arg, step, wait), D1(kind, (arg) + (step), step, wait)
+#define D4(kind, arg, step, wait)  D2(kind, arg, step, wait), D2(kind, (arg) + 2 * (step), step, wait)
+#define D8(kind, arg, step, wait)  D4(kind, arg, step, wait), D4(kind, (arg) + 4 * (step), step, wait)
+#define D16(kind, arg, step, wait) D8(kind, arg, step, wait), D8(kind, (arg) + 8 * (step), step, wait)
+#define D32(kind, arg, step, wait) D16(kind, arg, step, wait), D16(kind, (arg) + 16 * (step), step, wait)
+
+const Step decodeTable[256] = {
+  D32(STEP_END, 0, 0, 0),                  // 0x00 RECIPE_END
+  D4(STEP_MOVE, 1, 1, MOVE_WAIT),          // 0x20 MOV0..MOV3
+  D2(STEP_MOVE, 5, 1, MOVE_WAIT),          // 0x24 MOV4, MOV5
+  D2(STEP_BAD, 0, 0, 0),                   // 0x26 past MOV5
+  D8(STEP_BAD, 0, 0, 0),
+  D16(STEP_BAD, 0, 0, 0),
+  D32(STEP_WAIT, 0, 1, 0),                 // 0x40 WAIT
+  D32(STEP_BAD, 0, 0, 0),                  // 0x60
+  D32(STEP_LOOP, 0, 1, 0),                 // 0x80 START_LOOP
+  D32(STEP_NEXT, 0, 0, 0),                 // 0xA0 END_LOOP, target filled in by compileRecipe
+  D32(STEP_BAD, 0, 0, 0),                  // 0xC0
+  D32(STEP_BAD, 0, 0, 0)                   // 0xE0
+};
 
 // Updates LEDs and servos state for continue
 void unpause(UINT8 servo) {
-   if(!servos[servo].err) {
-    if(servo == LED_SERVO){
-      PORTB_BIT4 = 1;
+   if(!servos.err[servo]) {
+    if(IS_LED_SERVO(servo)){
+      halLed(LED_RUN, 1);
     }
-    servos[servo].pause = 0;
+    servos.paused &= (UINT8)~(1 << servo);
    }
 }
 
 // Updates LEDs and servo state to pause
 void pause(UINT8 servo) {
-   if(servo == LED_SERVO){
-    PORTB_BIT4 = 0;
+   if(IS_LED_SERVO(servo)){
+    halLed(LED_RUN, 0);
    }
-   servos[servo].pause = 1;
+   servos.paused |= (UINT8)(1 << servo);
 }
 
 // Updates LEDs and servo err state
 void err(UINT8 code, UINT8 servo) {
-  servos[servo].pause = 1;
-  servos[servo].err = 1;
-  if(servo == LED_SERVO){
+  servos.paused |= (UINT8)(1 << servo);
+  servos.err[servo] = 1;
+  if(IS_LED_SERVO(servo)){
   
     // bad opcode error
     if(code == 1){
-      PORTB_BIT7 = 0;
+      halLed(LED_BAD, 0);
     
     // nested loop error
     } else if(code == 2) {
-      PORTB_BIT6 = 0;
+      halLed(LED_NEST, 0);
     }
   }
 }
 
 // Remove err state
 void clearErr(UINT8 servo) {
-   if(servo == LED_SERVO){
-    PORTB_BIT7 = 1;
-    PORTB_BIT6 = 1;
+   if(IS_LED_SERVO(servo)){
+    halLed(LED_BAD, 1);
+    halLed(LED_NEST, 1);
    }
-   servos[servo].err = 0;
+   servos.err[servo] = 0;
 }
 
 // Set recipe end LED
 void ending(UINT8 servo){
-  if(servo == LED_SERVO) {
-    PORTB_BIT5 = 0;
+  if(IS_LED_SERVO(servo)) {
+    halLed(LED_END, 0);
   }
 }
 
 //Start or restart recipe
 void restart(UINT8 servo) {
-  servos[servo].recipeIndex = 0;
+  if(servos.loadErr[servo]) {
+    // Rejected recipe never runs, keep showing why
+    err(servos.loadErr[servo], servo);
+    return;
+  }
+  servos.recipeIndex[servo] = 0;
   clearErr(servo);
   unpause(servo);
-  if(servo == LED_SERVO) { 
-    PORTB_BIT5 = 1;
+  if(IS_LED_SERVO(servo)) { 
+    halLed(LED_END, 1);
   }
   
 }
 
 // Increment recipe Opcode by clock
+// Only servos that are ready and running cost anything, lowest numbered first
 void nextOp() {
-  UINT8 i = 0;
-  for(i; i < 2; i++) {
-    if(!servos[i].pause) {
-      if(servos[i].wait <= 0) {
-         parseOpcode(servos[i].recipe[servos[i].recipeIndex], i);
-         servos[i].recipeIndex++;
-      }
-    }
+  UINT8 run = servos.ready & (UINT8)~servos.paused & SERVO_MASK; // No bit past the last servo
+  UINT8 i;
+  while(run) {
+    i = (run & 0x0F) ? lowBit[run & 0x0F] : (UINT8)(4 + lowBit[run >> 4]);
+    run &= (UINT8)(run - 1);
+    runStep(i);
   }
 }
 
-// Calc wait time based on distance between positions
-UINT8 waitTime(UINT8 newPos, UINT8 oldPos) {
-  UINT8 diff;
-  if(newPos > oldPos) {
-    diff =  newPos - oldPos;
-   } else if(oldPos > newPos) {
-     diff = oldPos - newPos; 
-   }
-   if(diff <= 0) {
-    diff = 1;
-   }
-  return 20*diff;
-}
-
-// Wait using semaphore like variable
+// Servo runs its next step cycles ticks from now, replacing any wait it had
 void wait(UINT8 cycles, UINT8 servo) {
-  servos[servo].wait = 0;
-  servos[servo].wait +=cycles;
+  UINT8 bit = (UINT8)(1 << servo);
+  servos.due[servos.dueSlot[servo]] &= (UINT8)~bit;
+  if(cycles == 0) {
+    servos.ready |= bit;
+    return;
+  }
+  servos.ready &= (UINT8)~bit;
+  servos.dueSlot[servo] = (UINT8)((servos.now + cycles) & (DUE_SLOTS - 1));
+  servos.due[servos.dueSlot[servo]] |= bit;
 }
 
 // Set register to new postion number
 void move(UINT8 pos, UINT8 servo) {
-  servos[servo].curPos = pos;
-  *servos[servo].reg = calcMove(pos);
-}
-
-// Initialize variables in servo struct
-Servo initServo(Servo s) {
-  s.looping = 0;
-  s.wait = 0;
-  s.pause = 1;
-  s.recipeIndex = 0;
-  s.curPos = 0;
-  s.err = 0;
-  s.loops = 0;  s.curLoop = 0;  s.loopStartIndex = 0;
-  return s;
-}
-
-// Setup PWM registers
-void setupPWM(void) {
-  PWME_PWME0 = 1;
-  PWME_PWME1 = 1;
-  
-  PWMPOL_PPOL0 = 0;
-  PWMPOL_PPOL1 = 0;
-  
-  PWMCLK_PCLK0 = 1;
-  PWMCLK_PCLK1 = 1;
-  
-  PWMSCLA = 78;
-   
-  PWMPRCLK_PCKA0 = 0;
-  PWMPRCLK_PCKA1 = 0;
-  PWMPRCLK_PCKA2 = 0;
-  
-  PWMPER0 = 255; 
-  PWMPER1 = 255;
-  servos[0].reg = &PWMDTY0;
-  servos[1].reg = &PWMDTY1;
-  
+  servos.curPos[servo] = pos;
+  halSetDuty(servos.channel[servo], servos.duty[servo][pos]);
 }
 
-// Setup led registers
-void setupLed() {
-  DDRB |= 0xF0;
-  PORTB_BIT4 = 0;
-  PORTB_BIT5 = 1;
-  PORTB_BIT6 = 1;
-  PORTB_BIT7 = 1;
-};
+// Initialize servo's variables, paused and ready to run
+// Paused first, so a tick in between never runs a half set up servo
+void initServo(UINT8 servo) {
+  UINT8 pos;
+  servos.paused |= (UINT8)(1 << servo);
+  wait(0, servo);
+  servos.recipeIndex[servo] = 0;
+  servos.curPos[servo] = 0;
+  servos.err[servo] = 0;
+  servos.loops[servo] = 0;
+  servos.curLoop[servo] = 0;
+  servos.loadErr[servo] = 0;
+  servos.channel[servo] = servo;
+  for(pos = 0; pos <= POSITIONS; pos++) {
+    servos.duty[servo][pos] = defaultDuty[pos];
+  }
+}
 
 // Parses and executes a command line statement
-void parseCommand(UINT8 command, UINT8 servo) {
+// Returns 0 for an unknown command, which callers report
+UINT8 parseCommand(UINT8 command, UINT8 servo) {
    UINT8 downcasedCharacter = downcase(command);
    switch(downcasedCharacter) {
     case 'p':
@@ -362,15 +261,15 @@ void parseCommand(UINT8 command, UINT8 servo) {
       break;
     case 'r':
       //move right
-      if(servos[servo].curPos > 1) {
-        move(servos[servo].curPos-1, servo);
+      if(servos.curPos[servo] > 1) {
+        move(servos.curPos[servo]-1, servo);
         wait(20, servo);
       }
       break;
     case 'l':
       // Move left
-      if(servos[servo].curPos < 6) {
-        move(servos[servo].curPos+1, servo);
+      if(servos.curPos[servo] < 6) {
+        move(servos.curPos[servo]+1, servo);
         wait(20, servo);
       }
       break;
@@ -382,74 +281,109 @@ void parseCommand(UINT8 command, UINT8 servo) {
       restart(servo);
       break;
     default: 
-      (void)printf("Unknown character %c\r\n", downcasedCharacter); 
+      return 0;
    }
+   return 1;
 }
 
-// Parses and executes a recipe's opcode on a specific servo
-void parseOpcode(UINT8 command, UINT8 servo){
-   UINT8 opcode = (command & 0xE0)  >> 5;
-   UINT8 param = command & 0x1F;
-   UINT8 i = 0;
-   switch(opcode) {
-    case 1: // MOV
-      if(param < 0 || param > 5) {
-        err(1, servo); 
-        break;
-      }
-      move(param+1, servo);
-      wait(waitTime(param, servos[servo].curPos), servo);
-      break;
-    
-    case 2: //WAIT
-      if(param < 0 || param > 31) {
-        err(1, servo);
-        break;
-      }
-      wait(param, servo);
-      break;
-    
-    case 4: //LOOP START
-      if(servos[servo].looping){
-        err(2, servo);
-        break; 
-      }
-      if(param < 0 || param > 31) {
-        err(1, servo);
+// Verifies recipe once at load and translates it into program
+// Returns 0, or the err code for the first bad opcode (1) or nested loop (2),
+// with *at set to its index. Recipes must end in RECIPE_END within RECIPE_MAX
+// opcodes and close every loop they open.
+// MOV waits MOVE_WAIT ticks: the run time distance check compared the new
+// position with curPos after move() had already set it, so always 20 ticks
+UINT8 compileRecipe(UINT8 *recipe, Step *program, UINT8 *at) {
+  UINT8 loopStep = RECIPE_MAX; // Open STEP_LOOP, none
+  UINT8 i;
+  for(i = 0; i < RECIPE_MAX; i++) {
+    program[i] = decodeTable[recipe[i]];
+    *at = i;
+    switch(program[i].kind) {
+      case STEP_BAD:
+        return 1;
+
+      case STEP_LOOP:
+        if(loopStep != RECIPE_MAX) {
+          return 2;
+        }
+        loopStep = i;
         break;
-      }
-      servos[servo].looping = 1;
-      servos[servo].loops = param;
-      servos[servo].loopStartIndex = servos[servo].recipeIndex;
-      break;
-    
-    case 5:  //END LOOP
-      if(!servos[servo].looping) {
-        err(1, servo);
+
+      case STEP_NEXT:
+        if(loopStep == RECIPE_MAX) {
+          return 1;
+        }
+        program[i].arg = loopStep + 1;
+        loopStep = RECIPE_MAX;
         break;
-      }
-      
-      if(servos[servo].curLoop >= servos[servo].loops) {
-        servos[servo].looping = 0;
-      } else {
-        servos[servo].curLoop++;
-        servos[servo].recipeIndex = servos[servo].loopStartIndex; 
-      }
-      break;
-    
-    case 0: //END RECIPE
-      servos[servo].recipeIndex = 0;
-      pause(servo);
-      clearErr(servo);
-      ending(servo);
-      break;
-    default:
-      err(1, servo);
-      (void)printf("\r\nBad opcode %u", opcode);
-      newLine(); 
-      break;   
-    
-   }
+
+      case STEP_END:
+        return loopStep == RECIPE_MAX ? 0 : 1;
+    }
+  }
+  *at = RECIPE_MAX;
+  return 1;
+}
+
+// Compiles recipe into the servo's program, a rejected recipe leaves the
+// servo paused with its err LED lit until another recipe loads
+void loadRecipe(UINT8 servo, UINT8 *recipe) {
+  UINT8 at;
+  servos.recipe[servo] = recipe;
+  servos.recipeIndex[servo] = 0;
+  servos.loadErr[servo] = compileRecipe(recipe, servos.program[servo], &at);
+  if(servos.loadErr[servo]) {
+    err(servos.loadErr[servo], servo);
+    (void)printf("\r\nServo %u recipe rejected: %s at step %u", servo,
+      servos.loadErr[servo] == 2 ? "nested loop" : "bad opcode", at);
+  }
+}
+
+// Step handlers, one per kind, compileRecipe already checked every step
+void stepEnd(UINT8 servo, Step *step) {
+  (void)step;
+  servos.recipeIndex[servo] = 0;
+  pause(servo);
+  clearErr(servo);
+  ending(servo);
+  logEvent(LOG_END, servo);
+}
+
+void stepMove(UINT8 servo, Step *step) {
+  move(step->arg, servo);
+  wait(step->wait, servo);
+  servos.recipeIndex[servo]++;
+}
+
+void stepWait(UINT8 servo, Step *step) {
+  wait(step->arg, servo);
+  servos.recipeIndex[servo]++;
+}
+
+void stepLoop(UINT8 servo, Step *step) {
+  servos.loops[servo] = step->arg;
+  servos.curLoop[servo] = 0;
+  servos.recipeIndex[servo]++;
+}
+
+void stepNext(UINT8 servo, Step *step) {
+  if(servos.curLoop[servo] < servos.loops[servo]) {
+    servos.curLoop[servo]++;
+    servos.recipeIndex[servo] = step->arg;
+  } else {
+    servos.recipeIndex[servo]++;
+  }
+}
+
+// Handler for each step kind, indexed by Step.kind
+void (*const stepRun[STEP_KINDS])(UINT8 servo, Step *step) = {
+  stepEnd, stepMove, stepWait, stepLoop, stepNext
+};
+
+// Executes a servo's next step, one table call whatever the kind
+void runStep(UINT8 servo) {
+  Step *step = &servos.program[servo][servos.recipeIndex[servo]];
+  stepRun[step->kind](servo, step);
 }
 
 // Sets prompt character on newline 
@@ -457,6 +391,50 @@ void newLine() {
   (void)printf("\r\n>"); 
 }
 
+// Queues an event for logDrain to print, called from the ISR
+// Never waits on the serial port, a full ring drops the event and counts it
+void logEvent(UINT8 code, UINT8 servo) {
+  UINT8 head = logHead;
+  if((UINT8)(head - logTail) == LOG_SIZE) {
+    logDropped++;
+    return;
+  }
+  logRing[head & (LOG_SIZE - 1)].code = code;
+  logRing[head & (LOG_SIZE - 1)].servo = servo;
+  logHead = (UINT8)(head + 1); // Record is complete before main code can see it
+}
+
+// Prints every queued event and any drops since the last call, each on a
+// line of its own, main code only
+// Returns 0 if there was nothing to print, the caller redraws its prompt otherwise
+UINT8 logDrain(void) {
+  UINT8 tail = logTail;
+  UINT16 dropped;
+  LogRecord record;
+  if(tail == logHead && logDropped == logDroppedShown) {
+    return 0;
+  }
+  while(tail != logHead) {
+    record.code = logRing[tail & (LOG_SIZE - 1)].code;
+    record.servo = logRing[tail & (LOG_SIZE - 1)].servo;
+    tail++;
+    logTail = tail; // Slot is free once copied out
+    switch(record.code) {
+      case LOG_END:
+        (void)printf("\r\nServo %u recipe done", record.servo);
+        break;
+      default:
+        (void)printf("\r\nServo %u event %u", record.servo, record.code);
+    }
+  }
+  dropped = logDropped;
+  if(dropped != logDroppedShown) {
+    (void)printf("\r\n%u log records dropped", (UINT16)(dropped - logDroppedShown));
+    logDroppedShown = dropped;
+  }
+  return 1;
+}
+
 // Downcase ascii character
 UINT8 downcase(UINT8 character) {
   if(character < 0x61) {
@@ -466,22 +444,53 @@ UINT8 downcase(UINT8 character) {
   return character;
 }
 
-// Command line interface 
+#ifndef HOST_BUILD
+
+// Command line interface, one command character per servo then enter
 void cli(void) {
-  UINT8 buffer[2] = {0};
+  UINT8 buffer[SERVO_COUNT] = {0};
+  UINT8 known[SERVO_COUNT];
   UINT8 tmp = 0;
   UINT8 index = 0;
+  UINT8 i;
   (void)printf(">");
   for(;;) {
+    // Print what the ISR logged while waiting for a key, then put the prompt
+    // and the half typed line back under it
+    if(logDrain()) {
+      newLine();
+      for(i = 0; i < index; i++) {
+        (void)printf("%c", buffer[i]);
+      }
+    }
+    if(!halCharReady()) {
+      continue;
+    }
     tmp = GetChar();
     if(tmp == 'x' || tmp == 'X') {
       newLine();
       continue;
     }
+    if(tmp == 'w' || tmp == 'W') {
+      (void)printf("\r\nWorst ISR %u us, %u log records dropped", isrWorst, logDropped);
+      newLine();
+      continue;
+    }
     if(tmp == '\r') {
-      if(buffer[0] != 0 && buffer[1] != 0) {
-       	parseCommand(buffer[0], 0);
-        parseCommand(buffer[1], 1);
+      for(i = 0; i < SERVO_COUNT && buffer[i] != 0; i++) {
+      }
+      if(i == SERVO_COUNT) {
+        // Whole line applies between two ticks
+        halLock();
+        for(i = 0; i < SERVO_COUNT; i++) {
+          known[i] = parseCommand(buffer[i], i);
+        }
+        halUnlock();
+        for(i = 0; i < SERVO_COUNT; i++) {
+          if(!known[i]) {
+            (void)printf("Unknown character %c\r\n", downcase(buffer[i]));
+          }
+        }
       }
       newLine();
       index = 0;
@@ -490,7 +499,7 @@ void cli(void) {
        buffer[index] = tmp;
        index++; 
     }
-    if(index >= 2) {
+    if(index >= SERVO_COUNT) {
       index = 0;
     }
 
@@ -502,13 +511,317 @@ void cli(void) {
 //--------------------------------------------------------------       
 void main(void)
 {
-  InitializeSerialPort();
-  InitializeTimer();
-  setupPWM();
-  setupLed();
-  servos[0] = initServo(servos[0]);
-  servos[0].recipe = &standardRecipe;
-  servos[1] = initServo(servos[1]);
-  servos[1].recipe = &looping;
+  UINT8 i;
+  halInit();
+  // The timer interrupt is already running, keep it out until every servo
+  // has its program
+  halLock();
+  for(i = 0; i < SERVO_COUNT; i++) {
+    initServo(i);
+    loadRecipe(i, (i & 1) ? looping : standardRecipe);
+  }
+  halUnlock();
   cli();
-}
\ No newline at end of file
+}
+
+#else
+
+#include <stdlib.h>
+#include <string.h>
+
+// Recipes the host driver can run by name
+typedef struct{
+  const char* name;
+  UINT8* recipe;
+} NamedRecipe;
+
+NamedRecipe recipes[] = {
+  { "standard", standardRecipe },
+  { "looping", looping },
+  { "nested", nestedLoop },
+  { "allpos", testAllPos },
+  { "end", end },
+  { "bad", badOpcode }
+};
+
+#define HOST_COMMANDS 32
+#define BENCH_BYTES 4096 // Opcode bytes decoded per benchmark pass
+#define BENCH_TICKS 2000 // Ticks per recipe when timing the whole ISR
+#define BOARD_BAUD 9600 // SCI0 rate, 10 bit times per 8N1 character
+
+// The switch chain decode replaced by decodeTable, kept for the benchmark:
+// opcode field switch, range checks and the calcMove position switch
+UINT8 decodeSwitch(UINT8 command, Step *out) {
+  UINT8 opcode = (command & 0xE0) >> 5;
+  UINT8 param = command & 0x1F;
+  out->arg = param;
+  out->wait = 0;
+  switch(opcode) {
+    case 1: // MOV
+      if(param > 5) {
+        out->kind = STEP_BAD;
+        return 0;
+      }
+      out->kind = STEP_MOVE;
+      switch(param + 1) {
+        case 1: out->wait = 250; break;
+        case 2: out->wait = 245; break;
+        case 3: out->wait = 240; break;
+        case 4: out->wait = 235; break;
+        case 5: out->wait = 230; break;
+        default: out->wait = 225; break;
+      }
+      return 1;
+    case 2:
+      out->kind = STEP_WAIT;
+      return 1;
+    case 4:
+      out->kind = STEP_LOOP;
+      return 1;
+    case 5:
+      out->kind = STEP_NEXT;
+      return 1;
+    case 0:
+      out->kind = STEP_END;
+      return 1;
+    default:
+      out->kind = STEP_BAD;
+      return 0;
+  }
+}
+
+// The ISR's bad opcode branch before recipes were decoded at load, kept for
+// the benchmark: it was the ISR's worst path because it printed from there
+void badOpcodeSwitch(UINT8 command, UINT8 servo) {
+  Step step;
+  if(decodeSwitch(command, &step)) {
+    return;
+  }
+  err(1, servo);
+  (void)printf("\r\nBad opcode %u", (command & 0xE0) >> 5);
+  newLine();
+}
+
+// The switch dispatch replaced by stepRun, kept for the benchmark
+void runStepSwitch(UINT8 servo) {
+  Step *step = &servos.program[servo][servos.recipeIndex[servo]];
+  switch(step->kind) {
+    case STEP_MOVE: stepMove(servo, step); break;
+    case STEP_WAIT: stepWait(servo, step); break;
+    case STEP_LOOP: stepLoop(servo, step); break;
+    case STEP_NEXT: stepNext(servo, step); break;
+    default: stepEnd(servo, step); break;
+  }
+}
+
+// Time decoding random opcode bytes and executing standardRecipe's steps,
+// table driven against the switch chains, reps passes each
+void benchmark(unsigned long reps) {
+  static UINT8 bytes[BENCH_BYTES];
+  volatile unsigned long sink = 0;
+  unsigned long sum;
+  unsigned long long start;
+  unsigned long long tableNs;
+  unsigned long long switchNs;
+  unsigned long long beforeNs;
+  unsigned long long afterNs;
+  unsigned long serial;
+  unsigned long serialBefore;
+  unsigned long serialAfter;
+  unsigned long seed = 12345;
+  UINT8 i;
+  unsigned long r;
+  unsigned int b;
+  Step step;
+
+  for(b = 0; b < BENCH_BYTES; b++) {
+    seed = seed * 1103515245UL + 12345UL;
+    bytes[b] = (UINT8)(seed >> 16);
+  }
+  sum = 0;
+  start = halNanos();
+  for(r = 0; r < reps; r++) {
+    for(b = 0; b < BENCH_BYTES; b++) {
+      sum += decodeTable[bytes[b]].kind + decodeTable[bytes[b]].arg + servos.duty[0][decodeTable[bytes[b]].arg & 7];
+    }
+  }
+  tableNs = halNanos() - start;
+  sink += sum;
+  sum = 0;
+  start = halNanos();
+  for(r = 0; r < reps; r++) {
+    for(b = 0; b < BENCH_BYTES; b++) {
+      (void)decodeSwitch(bytes[b], &step);
+      sum += step.kind + step.arg + step.wait;
+    }
+  }
+  switchNs = halNanos() - start;
+  sink += sum;
+  fprintf(stderr, "decode:   table %.2f ns/opcode, switch %.2f ns/opcode\n",
+    (double)tableNs / ((double)reps * BENCH_BYTES), (double)switchNs / ((double)reps * BENCH_BYTES));
+
+  initServo(0);
+  loadRecipe(0, standardRecipe);
+  start = halNanos();
+  for(r = 0; r < reps * BENCH_BYTES; r++) {
+    runStep(0);
+  }
+  tableNs = halNanos() - start;
+  servos.recipeIndex[0] = 0;
+  start = halNanos();
+  for(r = 0; r < reps * BENCH_BYTES; r++) {
+    runStepSwitch(0);
+  }
+  switchNs = halNanos() - start;
+  fprintf(stderr, "dispatch: table %.2f ns/step, switch %.2f ns/step\n",
+    (double)tableNs / ((double)reps * BENCH_BYTES), (double)switchNs / ((double)reps * BENCH_BYTES));
+
+  // Worst ISR before and after load time decoding. The board's polled serial
+  // port holds the ISR for every character printed from it, which swamps the
+  // instructions, so the worst tick is the one printing the most
+  serialBefore = 0;
+  start = halNanos();
+  for(r = 0; r < reps; r++) {
+    serial = halHost.serialBytes;
+    badOpcodeSwitch(badOpcode[2], 0);
+    if(halHost.serialBytes - serial > serialBefore) serialBefore = halHost.serialBytes - serial;
+  }
+  beforeNs = halNanos() - start;
+  serialAfter = 0;
+  start = halNanos();
+  for(b = 0; b < sizeof(recipes) / sizeof(recipes[0]); b++) {
+    halInit();
+    for(i = 0; i < SERVO_COUNT; i++) {
+      initServo(i);
+      loadRecipe(i, recipes[(b + i) % (sizeof(recipes) / sizeof(recipes[0]))].recipe);
+      restart(i);
+    }
+    for(r = 0; r < BENCH_TICKS; r++) {
+      serial = halHost.serialBytes;
+      halRun(1);
+      if(halHost.serialBytes - serial > serialAfter) serialAfter = halHost.serialBytes - serial;
+    }
+  }
+  afterNs = halNanos() - start;
+  fprintf(stderr, "worst ISR: before %lu serial chars (%.1f ms at %u baud on the board, %.0f ns here),"
+    " after %lu serial chars (%.0f ns/tick here)\n", serialBefore, serialBefore * 10 * 1000.0 / BOARD_BAUD,
+    BOARD_BAUD, (double)beforeNs / reps, serialAfter,
+    (double)afterNs / (BENCH_TICKS * (sizeof(recipes) / sizeof(recipes[0]))));
+  (void)sink;
+}
+
+// Line of CLI characters, one per servo, entered before a given tick
+typedef struct{
+  unsigned long tick;
+  UINT8 chars[SERVO_COUNT];
+} HostCommand;
+
+// Fire ticks timer interrupts, draining the log after each like the board's
+// CLI loop would
+void runTicks(unsigned long ticks) {
+  while(ticks-- > 0) {
+    halRun(1);
+    if(logDrain()) {
+      newLine();
+    }
+  }
+}
+
+// Recipe by name, NULL if unknown
+UINT8* findRecipe(const char* name) {
+  UINT8 i;
+  for(i = 0; i < sizeof(recipes) / sizeof(recipes[0]); i++) {
+    if(strcmp(recipes[i].name, name) == 0) return recipes[i].recipe;
+  }
+  return NULL;
+}
+
+// Host driver: runs SERVO_COUNT recipes off the virtual timer and reports
+// every output the board would have produced
+// Usage: servo_host [-n ticks] [-v] [-b] [-c tick:xy..]... [recipe0 [recipe1 ..]]
+//   -c enters CLI characters x (servo 0), y (servo 1) and so on, one per
+//      servo, before tick, default is 0:cc.. to start every servo
+//   unnamed recipes alternate standard and looping like the board
+//   -b benchmarks table driven decode and dispatch against switch chains,
+//      and the worst ISR against the runtime decoding one
+int main(int argc, char* argv[]) {
+  HostCommand commands[HOST_COMMANDS];
+  int commandCount = 0;
+  unsigned long ticks = 1000;
+  unsigned long done = 0;
+  unsigned long long start;
+  unsigned long long elapsed;
+  UINT8* recipe[SERVO_COUNT];
+  const char* line;
+  int named = 0;
+  int arg;
+  int c;
+  UINT8 i;
+
+  // No getopt, unistd.h's pause() clashes with ours
+  for(i = 0; i < SERVO_COUNT; i++) {
+    recipe[i] = (i & 1) ? looping : standardRecipe;
+  }
+  for(arg = 1; arg < argc; arg++) {
+    if(strcmp(argv[arg], "-n") == 0 && arg + 1 < argc) {
+      ticks = strtoul(argv[++arg], NULL, 0);
+    } else if(strcmp(argv[arg], "-v") == 0) {
+      halHost.verbose = 1;
+    } else if(strcmp(argv[arg], "-b") == 0) {
+      halInit();
+      benchmark(2000);
+      return 0;
+    } else if(strcmp(argv[arg], "-c") == 0 && arg + 1 < argc && commandCount < HOST_COMMANDS
+        && (line = strchr(argv[arg + 1], ':')) != NULL && strlen(line + 1) == SERVO_COUNT) {
+      commands[commandCount].tick = strtoul(argv[++arg], NULL, 0);
+      memcpy(commands[commandCount].chars, line + 1, SERVO_COUNT);
+      commandCount++;
+    } else if(argv[arg][0] != '-' && named < SERVO_COUNT && (recipe[named] = findRecipe(argv[arg])) != NULL) {
+      named++;
+    } else {
+      fprintf(stderr, "Usage: %s [-n ticks] [-v] [-b] [-c tick:xy..]... [recipe0 [recipe1 ..]]\n", argv[0]);
+      return 1;
+    }
+  }
+  if(commandCount == 0) {
+    commands[0].tick = 0;
+    memset(commands[0].chars, 'c', SERVO_COUNT);
+    commandCount = 1;
+  }
+
+  halInit();
+  for(i = 0; i < SERVO_COUNT; i++) {
+    initServo(i);
+    loadRecipe(i, recipe[i]);
+  }
+  start = halNanos();
+  for(c = 0; c <= commandCount; c++) {
+    // Run up to the next command, or the end
+    if(c < commandCount && commands[c].tick < ticks) {
+      if(commands[c].tick > done) runTicks(commands[c].tick - done);
+      if(commands[c].tick > done) done = commands[c].tick;
+      for(i = 0; i < SERVO_COUNT; i++) {
+        if(!parseCommand(commands[c].chars[i], i)) {
+          (void)printf("Unknown character %c\r\n", downcase(commands[c].chars[i]));
+        }
+      }
+    } else if(done < ticks) {
+      runTicks(ticks - done);
+      done = ticks;
+    }
+  }
+  elapsed = halNanos() - start;
+
+  fprintf(stderr, "%lu ticks (%.1f virtual secs) in %.3f ms, %.0f ticks/sec\n", halHost.ticks,
+    halHost.tcnt / 1e6, elapsed / 1e6, elapsed ? halHost.ticks * 1e9 / elapsed : 0.0);
+  for(i = 0; i < SERVO_COUNT; i++) {
+    fprintf(stderr, "servo %u: duty %u (%lu writes), pos %u, index %u, %s%s\n", i,
+      halHost.duty[servos.channel[i]], halHost.dutyWrites[servos.channel[i]], servos.curPos[i],
+      servos.recipeIndex[i], (servos.paused >> i) & 1 ? "paused" : "running", servos.err[i] ? ", error" : "");
+  }
+  fprintf(stderr, "leds 0x%02X (%lu changes), %lu serial bytes, worst ISR %u ns, %u log records dropped\n",
+    halHost.leds, halHost.ledChanges, halHost.serialBytes, isrWorst, logDropped);
+  return 0;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,96 @@
+// Hardware abstraction for the servo recipe engine
+//
+// Board builds map every call straight onto HCS12 registers (hal_hcs12.h),
+// so the ISR costs the same as before. HOST_BUILD builds link
+// Sources/hal_host.c instead, which records PWM duty writes, LED levels and
+// serial output in halHost and drives OC1_isr from a virtual timer.
+#ifndef HAL_H
+#define HAL_H
+
+#include "types.h"
+
+// Change this value to change the frequency of the output compare signal.
+// The value is in Hz.
+#define OC_FREQ_HZ    ((UINT16)10)
+
+// Macro definitions for determining the TC1 value for the desired frequency
+// in Hz (OC_FREQ_HZ). The formula is:
+//
+// TC1_VAL = ((Bus Clock Frequency / Prescaler value) / 2) / Desired Freq in Hz
+//
+// Where:
+//        Bus Clock Frequency     = 2 MHz
+//        Prescaler Value         = 2 (Effectively giving us a 1 MHz timer)
+//        2 --> Since we want to toggle the output at half of the period
+//        Desired Frequency in Hz = The value you put in OC_FREQ_HZ
+//
+#define BUS_CLK_FREQ  ((UINT32) 2000000)
+#define PRESCALE      ((UINT16)  2)
+#define TC1_VAL       ((UINT16)  (((BUS_CLK_FREQ / PRESCALE) / 2) / OC_FREQ_HZ))
+
+// Servos driven, one PWM channel each from channel 0 up
+#ifndef SERVO_COUNT
+#define SERVO_COUNT 2
+#endif
+#if SERVO_COUNT < 1 || SERVO_COUNT > 8
+#error "SERVO_COUNT must be 1 to 8, the HCS12 has 8 PWM channels"
+#endif
+#define SERVO_MASK ((UINT8)((1 << SERVO_COUNT) - 1)) // Channel bits in PWM registers
+
+// PORTB bits of the status LEDs, all driven by LED_SERVO
+#define LED_RUN  4 // Set while running
+#define LED_END  5 // Cleared when the recipe ends
+#define LED_NEST 6 // Cleared on a nested loop error
+#define LED_BAD  7 // Cleared on a bad opcode
+
+#ifdef HOST_BUILD
+
+#include <stdio.h>
+
+#define HAL_CHANNELS 8 // PWM channels on the HCS12
+#define HAL_SERIAL 4096 // Serial output kept, oldest dropped first
+
+// Declares an interrupt handler, a plain function called by halRun here
+#define HAL_ISR(vector, name) void name(void)
+
+// Keep the ISR out while main code changes state it shares, nothing to do here
+#define halLock()
+#define halUnlock()
+
+// Everything the engine did to the outside world
+typedef struct{
+  UINT8 duty[HAL_CHANNELS]; // Last duty written per channel
+  unsigned long dutyWrites[HAL_CHANNELS];
+  UINT8 leds; // PORTB levels
+  unsigned long ledChanges;
+  char serial[HAL_SERIAL]; // Last HAL_SERIAL characters printed
+  unsigned long serialBytes; // Characters printed in total
+  unsigned long ticks; // Timer interrupts handled
+  unsigned long tcnt; // Virtual 1 MHz timer count
+  int verbose; // Boolean whether to print each output change as it happens
+} HalHost;
+
+extern HalHost halHost;
+
+void halInit(void);
+void halSetDuty(UINT8 channel, UINT8 duty);
+void halLed(UINT8 bit, UINT8 level);
+void halTimerNext(void);
+void halTimerAck(void);
+UINT16 halStamp(void);
+void halPutChar(INT8 ch);
+int halPrintf(const char* format, ...);
+void halRun(unsigned long ticks);
+unsigned long long halNanos(void);
+void OC1_isr(void);
+
+// Engine output goes to the recorded serial port
+#define printf halPrintf
+
+#else
+
+#include "hal_hcs12.h"
+
+#endif
+
+#endif
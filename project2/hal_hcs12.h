@@ -0,0 +1,176 @@
+// HCS12 backend of hal.h, only included through it from main.c
+// Output calls are macros so the ISR writes the registers directly. The board
+// setup and serial functions are defined here too, which keeps the
+// CodeWarrior project's file list as it was.
+#ifndef HAL_HCS12_H
+#define HAL_HCS12_H
+
+#include <hidef.h>      /* common defines and macros */
+#include <stdio.h>      /* Standard I/O Library */
+#include "derivative.h" /* derivative-specific definitions */
+
+// Interrupt handler on vector number
+#define HAL_ISR(vector, name) void interrupt vector name(void)
+
+// Keep the ISR out while main code changes state it shares
+#define halLock() DisableInterrupts
+#define halUnlock() EnableInterrupts
+
+// PWMDTY0..7 are consecutive registers
+#define halSetDuty(channel, duty) ((&PWMDTY0)[channel] = (duty))
+
+// Drive PORTB bit to level, constant bits compile to BSET/BCLR
+#define halLed(bit, level) \
+  do { \
+    if(level) PORTB |= (UINT8)(1 << (bit)); \
+    else PORTB &= (UINT8)~(1 << (bit)); \
+  } while(0)
+
+// Schedule the next output compare
+#define halTimerNext() (TC1 += TC1_VAL)
+
+// Clear the Output Compare Interrupt Flag (Channel 1)
+#define halTimerAck() (TFLG1 = TFLG1_C1F_MASK)
+
+// Free running timer count for measuring code, 1 us per count
+#define halStamp() (TCNT)
+
+
+// Initializes SCI0 for 8N1, 9600 baud, polled I/O
+// The value for the baud selection registers is determined
+// using the formula:
+//
+// SCI0 Baud Rate = ( 2 MHz Bus Clock ) / ( 16 * SCI0BD[12:0] )
+//--------------------------------------------------------------
+void InitializeSerialPort(void)
+{
+    // Set baud rate to ~9600 (See above formula)
+    SCI0BD = 13;
+
+    // 8N1 is default, so we don't have to touch SCI0CR1.
+    // Enable the transmitter and receiver.
+    SCI0CR2_TE = 1;
+    SCI0CR2_RE = 1;
+}
+
+
+// Initializes I/O and timer settings for the demo.
+//--------------------------------------------------------------
+void InitializeTimer(void)
+{
+  // Set the timer prescaler to %2, since the bus clock is at 2 MHz,
+  // and we want the timer running at 1 MHz
+  TSCR2_PR0 = 1;
+  TSCR2_PR1 = 0;
+  TSCR2_PR2 = 0;
+
+  // Enable output compare on Channel 1
+  TIOS_IOS1 = 1;
+
+  // Set up output compare action to toggle Port T, bit 1
+  TCTL2_OM1 = 0;
+  TCTL2_OL1 = 1;
+
+  // Set up timer compare value
+  TC1 = TC1_VAL;
+
+  // Clear the Output Compare Interrupt Flag (Channel 1)
+  TFLG1 = TFLG1_C1F_MASK;
+
+  // Enable the output compare interrupt on Channel 1;
+  TIE_C1I = 1;
+
+  //
+  // Enable the timer
+  //
+  TSCR1_TEN = 1;
+
+  //
+  // Enable interrupts via macro provided by hidef.h
+  //
+  EnableInterrupts;
+}
+
+// Setup PWM registers for channels 0 to SERVO_COUNT - 1
+// Channels 0, 1, 4 and 5 run off scaled clock SA, 2, 3, 6 and 7 off SB,
+// both set up the same
+void setupPWM(void) {
+  UINT8 ch;
+  PWME |= SERVO_MASK;
+  PWMPOL &= (UINT8)~SERVO_MASK;
+  PWMCLK |= SERVO_MASK;
+
+  PWMSCLA = 78;
+  PWMSCLB = 78;
+
+  PWMPRCLK_PCKA0 = 0;
+  PWMPRCLK_PCKA1 = 0;
+  PWMPRCLK_PCKA2 = 0;
+  PWMPRCLK_PCKB0 = 0;
+  PWMPRCLK_PCKB1 = 0;
+  PWMPRCLK_PCKB2 = 0;
+
+  // PWMPER0..7 are consecutive registers
+  for(ch = 0; ch < SERVO_COUNT; ch++) {
+    (&PWMPER0)[ch] = 255;
+  }
+}
+
+// Setup led registers
+void setupLed() {
+  DDRB |= 0xF0;
+  PORTB_BIT4 = 0;
+  PORTB_BIT5 = 1;
+  PORTB_BIT6 = 1;
+  PORTB_BIT7 = 1;
+}
+
+// Bring up the serial port, timer, PWM and LEDs
+void halInit(void) {
+  InitializeSerialPort();
+  InitializeTimer();
+  setupPWM();
+  setupLed();
+}
+
+// This function is called by printf in order to
+// output data. Our implementation will use polled
+// serial I/O on SCI0 to output the character.
+//
+// Remember to call InitializeSerialPort() before using printf!
+//
+// Parameters: character to output
+//--------------------------------------------------------------
+void TERMIO_PutChar(INT8 ch)
+{
+    // Poll for the last transmit to be complete
+    do
+    {
+      // Nothing
+    } while (SCI0SR1_TC == 0);
+
+    // write the data to the output shift register
+    SCI0DRL = ch;
+}
+
+
+// Nonzero once a received character is waiting for GetChar()
+#define halCharReady() (SCI0SR1_RDRF != 0)
+
+// Polls for a character on the serial port.
+//
+// Returns: Received character
+//--------------------------------------------------------------
+UINT8 GetChar(void)
+{
+  // Poll for data
+  do
+  {
+    // Nothing
+  } while(SCI0SR1_RDRF == 0);
+
+  // Fetch and return data from SCI0
+  return SCI0DRL;
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "types.h"
+#include "hal.h" // SERVO_COUNT
 // Convenience definitions of Opcodes
 #define MOV        0x20
 #define MOV0       MOV
@@ -12,39 +13,83 @@
 #define END_LOOP   0xA0
 #define RECIPE_END 0
 
-// structure to hold all servo related info/states
+#define RECIPE_MAX 32 // Most opcodes in a recipe, RECIPE_END included
+#define MOVE_WAIT 20 // Ticks after every MOV, see compileRecipe()
+
+// Pre-decoded recipe steps, what compileRecipe turns opcodes into
+#define STEP_END  0 // Recipe finished, pause
+#define STEP_MOVE 1 // Move to position arg then wait wait ticks
+#define STEP_WAIT 2 // Wait arg ticks
+#define STEP_LOOP 3 // Start of a loop body repeated arg more times
+#define STEP_NEXT 4 // End of loop body, arg is the step after its STEP_LOOP
+#define STEP_KINDS 5 // Kinds a loaded program can hold
+#define STEP_BAD  5 // Invalid opcode, only seen while decoding
+
+#define POSITIONS 6 // Servo positions, numbered from 1
+
+// One verified recipe step
 typedef struct{
-  UINT8 looping;
-  UINT8 loops;  //number of loops to do
-  UINT8 curLoop; // current loop cycle
-  UINT8 loopStartIndex;
+  UINT8 kind; // STEP_*
+  UINT8 arg;
   UINT8 wait;
-  UINT8 curPos;
-  UINT8 pause;
-  UINT8 recipeIndex;
-  UINT8 *recipe;
-  UINT8 *reg;
-  UINT8 err; 
-} Servo;
+} Step;
+
+#define DUE_SLOTS 32 // Due wheel slots, more than the longest wait (31 ticks)
+
+// All servo related info/states, one array entry per servo (SERVO_COUNT
+// from hal.h) so the ISR touches only the fields it needs
+// Servo n is bit n of the masks
+typedef struct{
+  UINT8 loops[SERVO_COUNT];  //number of loops to do
+  UINT8 curLoop[SERVO_COUNT]; // current loop cycle
+  UINT8 curPos[SERVO_COUNT];
+  UINT8 recipeIndex[SERVO_COUNT]; // Next step of program
+  UINT8 dueSlot[SERVO_COUNT]; // due slot the servo last waited on
+  UINT8 err[SERVO_COUNT];
+  UINT8 loadErr[SERVO_COUNT]; // err code recipe was rejected with, 0 if it loaded
+  UINT8 channel[SERVO_COUNT]; // PWM channel driven
+  UINT8 *recipe[SERVO_COUNT];
+  Step program[SERVO_COUNT][RECIPE_MAX]; // recipe after compileRecipe
+  UINT8 duty[SERVO_COUNT][POSITIONS + 1]; // PWM duty for each position, calibrated per servo
+  UINT8 ready; // Servos whose wait is over
+  UINT8 paused; // Servos paused, by command, recipe end or error
+  UINT8 now; // Ticks so far, wrapping
+  UINT8 due[DUE_SLOTS]; // Servos whose wait ends at each tick, by tick % DUE_SLOTS
+} Servos;
+
+// ISR log latency: at 9600 baud a character takes 1.04 ms. A record waits
+// for the CLI output already going out (at most 50 characters with 2 servos,
+// the 'w' reply and prompt) and for the records ahead of it (21 characters
+// each). With LOG_SIZE 16 it is printed within 50 + 16 * 21 = 386
+// characters, 0.40 s or 8 ticks
+#define LOG_SIZE 16 // Log records held, a power of two up to 128
+#define LOG_END 1 // Servo's recipe finished
+
+// Event the ISR logs for main code to print, see logEvent()
+typedef struct{
+  UINT8 code; // LOG_*
+  UINT8 servo;
+} LogRecord;
 
 UINT8 downcase(UINT8 character);
 void setup(void);
-void parseOpcode(UINT8 command, UINT8 servo);
-Servo initServo(Servo s);
+UINT8 compileRecipe(UINT8 *recipe, Step *program, UINT8 *at);
+void loadRecipe(UINT8 servo, UINT8 *recipe);
+void runStep(UINT8 servo);
+void initServo(UINT8 servo);
 void newLine(void);
+void logEvent(UINT8 code, UINT8 servo);
+UINT8 logDrain(void);
 void unpause(UINT8 servo);
 void pause(UINT8 servo);
 void err(UINT8 code, UINT8 servo);
 void clearErr(UINT8 servo);
 void restart(UINT8 servo);
 void nextOp(void);
-UINT8 calcMove(UINT8 pos);
 void wait(UINT8 cycles, UINT8 servo);
 void move(UINT8 pos, UINT8 servo);
-void setupPWM(void);
 void cli(void);
-UINT8 waitTime(UINT8 newPos, UINT8 oldPos);
-void parseCommand(UINT8 command, UINT8 servo);
+UINT8 parseCommand(UINT8 command, UINT8 servo);
 
 UINT8 standardRecipe[20] = {
   MOV0, 
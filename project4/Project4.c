@@ -1,350 +1,3848 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <unistd.h>
+#include <stdint.h>
+#ifdef __QNX__
 #include <sys/neutrino.h>
 #include <sys/netmgr.h>
 #include <sys/syspage.h>
-#include <unistd.h>
-#include <stdint.h>
 #include <hw/inout.h>
+#endif
+#ifdef __linux__
+#include <sys/timerfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
 #include <sys/mman.h>
 #include <assert.h>
 #include <errno.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <math.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "trace.h"
+#include "metrics.h"
 
-#define TELLER_NUM 3
-#define OPEN_HOURS 1
+#define TELLER_NUM 3 // Default teller count
+#define OPEN_HOURS 1 // Default hours open
+#define CACHE_LINE 64
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE))) // Start member on its own cache line
+#define RING_SIZE 4096 // Lock-free customer ring capacity, must be a power of two
+#define TRACE_RING 8192 // Trace records buffered per writer thread, must be a power of two
+#define TRACE_WRITERS 64 // Most threads one trace records from
+#define TRACE_WINDOW (24 * 4096 * 8) // Trace file bytes mapped at once, whole pages and whole records
+#define LINE_SIZE 16 // Initial per-teller line capacity, must be a power of two
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_BITS) // Slots per timer wheel level
+#define WHEEL_LEVELS 3 // Levels cover deadlines up to 2^24 fake seconds out
+#define TICK_NS 1700000 // Default real time per fake second
+#define RNG_BATCH 64 // Samples generated per refill
+#define RNG_GAMMA 0x9E3779B97F4A7C15ULL // SplitMix64 counter increment
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS) // Linear sub-buckets per power of two (~6% resolution)
+#define HIST_BUCKETS ((32 - HIST_SUB_BITS + 1) * HIST_SUB) // Enough for any non-negative int
 
 // Linked list node construct for customer Queue
-// Also holds individual bank processing stats
 // All time fields are in simulated seconds
+// Holds only what lines and tellers touch on a hand-off, the depth an arrival
+// saw goes straight into the generator's stats instead of riding along
 typedef struct Customer{
-  int id; // Customer id (in order of bank entry)
   struct Customer* next; // Next customer in line
   int startWaitTime; // When customer began waiting since bank opened
-  int endWaitTime; // When customer stopped waiting since bank opened
-  int tellWaitTime; // Duration of time teller waited for a customer between prev customer and this customer
   int transTime; // Duration of time teller transacted with customer
-  int depth; // Current depth of customer in queue
-  int startingDepth; // Starting depth of customer in queue
-  pthread_mutex_t wait; // Mutex for conditional wait (used in simulating transaction time)
+  int id; // Customer id (in order of bank entry), only read for tracing
 }Customer;
 
+// Streaming summary of one metric, constant size however many samples
+typedef struct Metric{
+  long count;
+  long long sum;
+  int max;
+  unsigned int hist[HIST_BUCKETS]; // Log-bucketed sample counts (HDR style)
+}Metric;
+
+// Metrics one teller records as it serves, written only by that teller
+typedef struct TellerStats{
+  Metric custWait CACHE_ALIGNED; // Time customer spent in queue, no line shared with the next teller
+  Metric transTime; // Time teller spent with customer
+  Metric tellWait; // Time teller sat idle before customer
+}TellerStats;
+
+#define STAFF_BATCH 16 // Days per round when testing a teller count
+#define STAFF_MAX_REPS 512 // Days after which an undecided count is judged on its mean
+#define STAFF_MAX_TELLERS 4096 // Largest teller count the optimizer tries
+
+#define MAILBOX_SIZE 4096 // Transfers one branch can send per window, more are refused
+
+#define POOL_SLAB 1024 // Customers carved from each slab
+#define POOL_BATCH 64 // Freed customers a thread keeps before returning them to the depot
+
+// Block of customer records, released together at end of day
+typedef struct Slab{
+  struct Slab* next; // Previously allocated slab
+  Customer custs[POOL_SLAB];
+}Slab;
+
+// Slab allocator for the day's customers
+typedef struct CustomerPool{
+  pthread_mutex_t lock; // Guards slabs and depot
+  Slab* slabs; // Every slab handed out today
+  Customer* depot; // Customers freed by other threads, linked by next
+  int depotCount; // Number of customers in depot, changed under lock but peeked without it
+  long allocs; // Customers handed out
+  long slabAllocs; // Slabs malloc'd
+}CustomerPool;
+
+// Per-thread cache in front of the pool, owned by exactly one thread
+// Only touches the pool lock to grab a new slab or trade a batch with the depot
+typedef struct PoolCache{
+  Slab* slab; // Slab currently being carved
+  int slabUsed; // Customers carved from slab
+  Customer* free; // Customers freed by this thread, linked by next
+  Customer* freeTail;
+  int freeCount;
+  long allocs; // Customers handed out through this cache
+}PoolCache;
+
+// FIFO of customers with constant time enqueue and dequeue
+typedef struct Queue{
+  Customer* head; // Next customer out
+  Customer* tail; // Last customer in
+  int depth; // Number of customers in queue
+}Queue;
+
+// Slot in the lock-free customer ring
+typedef struct RingSlot{
+  unsigned int seq; // Ring position this slot is ready for (producer) or holds (consumer + 1)
+  Customer* cust;
+}RingSlot;
+
+// Bounded multi-producer/multi-consumer ring of customers
+// Each slot carries a sequence number so producers and consumers claim
+// positions with a single compare-and-swap (Vyukov style)
+typedef struct Ring{
+  unsigned int enqPos; // Next position to fill
+  char pad0[CACHE_LINE - sizeof(unsigned int)];
+  unsigned int deqPos; // Next position to take
+  char pad1[CACHE_LINE - sizeof(unsigned int)];
+  int depth; // Number of customers in ring
+  char pad2[CACHE_LINE - sizeof(int)];
+  RingSlot slots[RING_SIZE];
+}Ring;
+
+// One teller's own line, a growable ring of customers
+// Owner serves from the head, idle peers steal from the tail
+typedef struct Deque{
+  pthread_mutex_t lock; // Guards every field but depth reads
+  Customer** custs;
+  int cap; // Slots in custs, a power of two
+  int head; // Slot of next customer out
+  int depth; // Number of customers in line, read unlocked when choosing a line
+}Deque;
+
+// How arriving customers pick a line
+typedef enum Discipline{
+  DISC_SHARED = 0, // One line for every teller
+  DISC_JSQ, // Line per teller, join the shortest
+  DISC_RR // Line per teller, assigned in turn
+}Discipline;
+
 // Wrapper for customer queue/line for tellers
 typedef struct Customers{
-  pthread_mutex_t lock; // Access mutex for queue
-  Customer* q; // actual queue
-  sem_t semaphore; // Semaphore indicating number of customers in queue
+  pthread_mutex_t lock CACHE_ALIGNED; // Access mutex for queue
+  Queue q; // actual queue
+  sem_t semaphore CACHE_ALIGNED; // Semaphore indicating number of customers in queue
+  Ring ring CACHE_ALIGNED; // Lock-free queue used when lockFree is set
+  int lockFree; // Boolean whether tellers use ring instead of q
+  int nextLine; // Teller line the next arrival joins (DISC_RR), generator only
   pthread_t thread; // Self thread
 }Customers;
 
+// Sleeper registered on the simulated clock
+typedef struct Timer{
+  int deadline; // Fake second to wake at
+  int fired; // Boolean set by the clock once deadline is reached
+  pthread_cond_t wake; // Signalled once, when fired
+  struct Timer* next; // Next timer in the same wheel slot
+}Timer;
+
+// OS mechanism driving the simulated clock
+typedef enum TickBackend{
+  TICK_PULSE = 0, // QNX timer pulse on a channel
+  TICK_NANOSLEEP, // POSIX clock_nanosleep to absolute deadlines
+  TICK_TIMERFD // Linux timerfd
+}TickBackend;
+
+// Periodic tick source plus real time accounting
+typedef struct TickSource{
+  TickBackend backend;
+  long periodNs; // Nominal tick period
+  int chid; // Pulse channel (TICK_PULSE)
+  timer_t timer; // Pulse timer (TICK_PULSE)
+  int fd; // Timer descriptor (TICK_TIMERFD)
+  struct timespec next; // Next absolute wakeup (TICK_NANOSLEEP)
+  uint64_t start; // Wall time the source was armed
+  uint64_t ticks; // Periods elapsed since start
+  long overruns; // Periods that passed without a wakeup of their own
+  long missed; // Wakeups that covered more than one period
+  int64_t lateNs; // Current drift behind the ideal schedule
+  int64_t maxLateNs; // Worst drift behind the ideal schedule
+  uint64_t last; // Wall time of previous wakeup
+  Metric interval; // Real ns between consecutive wakeups
+}TickSource;
+
 // Simulated time clock
 // Ticks every 1.7 ms (approximately 1 simulated second)
+// secs is written every tick and read by every thread, so it gets a line to
+// itself; the waiter lock/condition share the next, read-mostly setup the next
 typedef struct ClockSim{
-  int secs; // # of fake secs bank has been open
+  int secs CACHE_ALIGNED; // # of fake secs bank has been open, read with clockNow()
+  pthread_mutex_t lock CACHE_ALIGNED; // Guards wheel and secs updates for timer waiters
   pthread_cond_t tick; // Condition for clock tick waiting
-  pthread_mutex_t lock;
+  int closeTime CACHE_ALIGNED; // Fake second the bank closes at
+  int useWheel; // Boolean whether waiters use the timer wheel instead of tick broadcasts
+  int catchUp; // Boolean whether secs advances by every elapsed period, not one per wakeup
+  long periodNs; // Real time per fake second
   int kill; // flag to kill clock
   pthread_t thread; // Self thread
+  Timer* wheel[WHEEL_LEVELS][WHEEL_SLOTS]; // Hierarchical timer wheel of pending deadlines
+  TickSource ticker; // Drives the clock thread
+  Metric fanout; // Real ns spent waking waiters each tick
 }ClockSim;
 
+// Shape of a random duration, all values in fake seconds
+typedef enum DistType{
+  DIST_UNIFORM = 0, // Uniform on [min, max)
+  DIST_EXPONENTIAL, // min plus an exponential tail, overall mean of mean
+  DIST_ERLANG // min plus an Erlang-k tail, overall mean of mean
+}DistType;
+
+// Random duration parameters
+typedef struct Dist{
+  DistType type;
+  int min;
+  int max; // Uniform only
+  double mean; // Exponential/Erlang only
+  int k; // Erlang shape, 1 is exponential, at most RNG_BATCH
+}Dist;
+
+// Random stream identifiers, one counter sequence each per replication
+typedef enum RngStream{
+  STREAM_ARRIVAL = 0, // Inter-arrival gaps
+  STREAM_SERVICE // Transaction times, drawn in customer id order
+}RngStream;
+
+// Counter-based generator (SplitMix64 in counter mode)
+// Draw n of a stream is mix(key + n * gamma), so every draw is fixed by
+// (seed, replication, stream, n) no matter which thread asks for it
+typedef struct Rng{
+  uint64_t key; // Hash of seed, replication and stream
+  uint64_t counter; // Index of next draw
+}Rng;
+
+// Batch of pre-generated durations from one distribution
+typedef struct Sampler{
+  Rng rng;
+  Dist dist;
+  int buf[RNG_BATCH]; // Next durations to hand out
+  int pos; // Next unread entry of buf
+}Sampler;
+
+#define ARRIVAL_MAGIC "BNKARRV1" // First 8 bytes of a binary arrival log
+
+// Binary arrival log record, native byte order, in arrival order
+typedef struct ArrivalRecord{
+  int32_t secs; // Arrival second since the bank opened
+  int32_t service; // Transaction time override, negative to sample cfg.service
+}ArrivalRecord;
+
+// Arrival log mapped read only, shared by every day that replays it
+// Binary logs are ARRIVAL_MAGIC then ArrivalRecords, anything else is read as
+// CSV lines of secs[,service], lines not starting with a digit are skipped
+typedef struct ArrivalLog{
+  const char* data; // Whole file
+  size_t len;
+  int binary; // Boolean whether data holds ArrivalRecords
+  size_t start; // Offset of first record
+}ArrivalLog;
+
+// One day's cursor over arrivals, sampled or replayed from a log
+typedef struct ArrivalSource{
+  Sampler arrivals; // Inter-arrival gaps when there is no log
+  Sampler services; // Transaction times, drawn per customer even when overridden
+  const ArrivalLog* log; // NULL to sample
+  size_t pos; // Offset of next record in log
+  int last; // Previous arrival second from log
+  int service; // Transaction time of the customer the last gap led to
+}ArrivalSource;
+
+// Run parameters, set from the command line or a config file
+typedef struct Config{
+  int tellers; // Number of tellers
+  int openHours; // Hours the bank lets customers in
+  long tickNs; // Real time per fake second (threaded mode)
+  TickBackend tickBackend; // OS mechanism driving the clock (threaded mode)
+  int useWheel; // Boolean whether waiters use the timer wheel (threaded mode)
+  int lockFree; // Boolean whether tellers share the lock-free ring (threaded mode)
+  int catchUp; // Boolean whether a late clock skips ahead by the periods it missed (threaded mode)
+  Discipline discipline; // Shared line or a line per teller
+  uint64_t seed; // Base seed every random stream is keyed from
+  Dist arrive; // Customer inter-arrival time
+  Dist service; // Teller transaction time
+  ArrivalLog* arrivalLog; // Replayed arrivals replacing arrive, NULL to sample
+  int transferDepth; // Line length at which arrivals are sent to the next branch (multi-branch)
+  int transferSecs; // Trip between branches, also the shards' lookahead (multi-branch)
+}Config;
+
+// Single-producer/single-consumer ring of trace records for one thread
+typedef struct TraceRing{
+  unsigned int head; // Next record to write (producer)
+  char pad0[CACHE_LINE - sizeof(unsigned int)];
+  unsigned int tail; // Next record to drain (consumer)
+  char pad1[CACHE_LINE - sizeof(unsigned int)];
+  int block; // Boolean whether producer waits for room instead of dropping
+  int done; // Boolean set once the producer will never record again
+  long dropped; // Records lost because ring was full (producer)
+  TraceRecord recs[TRACE_RING];
+}TraceRing;
+
+// Trace being recorded, drained by a background thread into a mapped file
+typedef struct Trace{
+  int fd;
+  char* window; // Mapped part of file being filled
+  off_t windowOff; // File offset of window
+  size_t windowUsed; // Bytes of window filled
+  TraceHeader header;
+  TraceRing* rings[TRACE_WRITERS]; // Published once allocated, NULL until then
+  int writers; // Rings claimed (atomic)
+  int kill; // Flag to stop drain thread
+  pthread_t thread; // Drain thread
+}Trace;
+
+// Growable byte buffer a snapshot is built in
+typedef struct SnapBuf{
+  char* data;
+  size_t len;
+  size_t cap;
+}SnapBuf;
+
+// Periodic snapshots of an event engine day, written off the simulation thread
+typedef struct Checkpoint{
+  const char* path; // Snapshot file, replaced whole each time
+  int every; // Simulated seconds between snapshots
+  SnapBuf buf; // Latest snapshot, owned by the writer thread while writing
+  int writing; // Boolean whether a writer thread is running
+  pthread_t thread; // Writer thread
+  int written; // Snapshots safely on disk
+}Checkpoint;
+
+struct Bank;
+
+// Teller thread handle
+typedef struct Teller{
+  pthread_t thread; // Self thread
+  int id; // Index into Bank.tellerStats
+  struct Bank* bank; // Bank this teller works at
+  Deque line CACHE_ALIGNED; // Own line (DISC_JSQ and DISC_RR), kept off neighbouring tellers' lines
+}Teller;
+
 // Bank Vars Wrapper
+// Hot members start cache lines so the clock, the generator and the tellers
+// do not invalidate each other's lines; must be allocated with cacheAlloc()
 typedef struct Bank{
-  int closed; // Boolean whether bank is closed
   ClockSim clock; // Clock simulation wrapper
-  pthread_t thread; // Self thread
+  int closed CACHE_ALIGNED; // Boolean whether bank is closed
   pthread_mutex_t lock; //variable access lock
+  Customers customers; // Wrapper around queue of customers to be served
+  Metric depth CACHE_ALIGNED; // Queue depth seen by each arrival, written only by the generator
+  pthread_t thread CACHE_ALIGNED; // Self thread
   pthread_mutex_t wait; //mutex for conditional wait
   pthread_cond_t open; //condition for conditional wait
-  Customers customers; // Wrapper around queue of customers to be served
-  Customer* served; // Queue of customers already served
-  pthread_t tellers[TELLER_NUM]; // Teller Threads
+  Config cfg; // Parameters for this bank's days
+  TellerStats* tellerStats; // Per teller accumulators, merged by stats()
+  CustomerPool pool; // Storage for every customer of the day
+  Teller* tellers; // Teller Threads
+  int tellersAllocated; // Entries in tellers and tellerStats
+  unsigned int replication; // Replication number, keys streams with cfg.seed
+  int quiet; // Boolean whether to skip open/close messages
+  Trace* trace; // Event trace, NULL when not recording
+  MetricsSegment* metrics; // Live metrics shared memory, NULL when not publishing (threaded mode)
+  Checkpoint* checkpoint; // Snapshot schedule, NULL when not checkpointing (event engine)
 }Bank;
 
 // Global Var
 Bank bank;
 
-// Params in fake seconds
-unsigned int randomWait(unsigned int minSecs, unsigned int maxSecs, unsigned int* seed, Customer* cust) {
-  unsigned int waitTime = minSecs + rand_r(seed) % (maxSecs - minSecs);
-  unsigned int counter  = waitTime;
-  pthread_mutex_lock(&cust->wait);
-  while(counter > 0) {
-    pthread_cond_wait(&bank.clock.tick, &cust->wait); //wait for sim clock tick
-    counter--;
+// Zeroed allocation starting on a cache line, for structs with CACHE_ALIGNED members
+void* cacheAlloc(size_t bytes) {
+  void* p = NULL;
+  if(posix_memalign(&p, CACHE_LINE, bytes) != 0) return NULL;
+  memset(p, 0, bytes);
+  return p;
+}
+
+// Current fake second, safe to read from any thread without the clock lock
+static inline int clockNow(ClockSim* clock) {
+  return __atomic_load_n(&clock->secs, __ATOMIC_RELAXED);
+}
+
+// Advance the fake clock, only the clock thread calls this
+static inline void clockAdvance(ClockSim* clock, int secs) {
+  __atomic_store_n(&clock->secs, clock->secs + secs, __ATOMIC_RELAXED);
+}
+
+// Monotonic wall clock in nanoseconds
+uint64_t nowNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// SplitMix64 finaliser
+static inline uint64_t mix64(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+// Key generator to one stream of one replication
+void rngInit(Rng* rng, uint64_t seed, unsigned int replication, RngStream stream) {
+  rng->key = mix64(seed + mix64(((uint64_t)replication << 32) | (unsigned int)stream));
+  rng->counter = 0;
+}
+
+// Next n raw draws, written as one straight loop so it vectorises
+void rngFill(Rng* rng, uint64_t* out, int n) {
+  uint64_t base = rng->key + rng->counter * RNG_GAMMA;
+  int i;
+  for(i = 0; i < n; i++) out[i] = mix64(base + (uint64_t)i * RNG_GAMMA);
+  rng->counter += n;
+}
+
+// Top 53 bits of a draw as a double in [0, 1)
+static inline double rngUnit(uint64_t x) {
+  return (x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Regenerate a sampler's whole buffer
+void samplerRefill(Sampler* s) {
+  uint64_t raw[RNG_BATCH];
+  double tail;
+  double scale;
+  int i;
+  int j;
+  switch(s->dist.type) {
+    case DIST_EXPONENTIAL:
+    case DIST_ERLANG:
+      // Erlang-k is the sum of k exponentials, scaled so the tail keeps its mean
+      scale = (s->dist.mean - s->dist.min) / s->dist.k;
+      for(i = 0; i < RNG_BATCH; i++) {
+        tail = 0;
+        rngFill(&s->rng, raw, s->dist.k);
+        for(j = 0; j < s->dist.k; j++) tail -= log(1.0 - rngUnit(raw[j]));
+        s->buf[i] = s->dist.min + (int)(tail * scale + 0.5);
+      }
+      break;
+    default:
+      rngFill(&s->rng, raw, RNG_BATCH);
+      for(i = 0; i < RNG_BATCH; i++) {
+        s->buf[i] = s->dist.min + (int)(rngUnit(raw[i]) * (s->dist.max - s->dist.min));
+      }
+      break;
   }
-  pthread_mutex_unlock(&cust->wait);
-  return waitTime;
+  s->pos = 0;
 }
 
-// Traverses linked list to the tail
-Customer* traverse(Customer* head, int* depth) {
-  if(head == NULL) return head;
-  (*depth)++;
-  head->depth = *depth;
-  if(head->next == NULL) return head;
-  return traverse(head->next, depth);
+// Start sampler on one stream of one replication
+void samplerInit(Sampler* s, Dist* dist, uint64_t seed, unsigned int replication, RngStream stream) {
+  rngInit(&s->rng, seed, replication, stream);
+  s->dist = *dist;
+  s->pos = RNG_BATCH; // Filled on first draw
 }
 
-// Convenience method for finding tail
-Customer* findTail(Customer* head) {
-  int tailDepth = 0;
-  return traverse(head, &tailDepth);
+// Next duration
+static inline int sampleNext(Sampler* s) {
+  if(s->pos == RNG_BATCH) samplerRefill(s);
+  return s->buf[s->pos++];
 }
 
-// Remove next node for queue and return it
-Customer* dequeue(Customer** queue) {
-  Customer* head = NULL;
-  if(*queue != NULL) {
-    head = *queue;
-    if((*queue)->next != NULL) {
-      *queue = (*queue)->next;
-    } else {
-      *queue = NULL;
+// Parse uniform:min:max, exp:min:mean or erlang:min:mean:k, returns 0 on bad spec
+int parseDist(const char* spec, Dist* dist) {
+  Dist d;
+  memset(&d, 0, sizeof(Dist));
+  d.k = 1;
+  if(sscanf(spec, "uniform:%d:%d", &d.min, &d.max) == 2 && d.max > d.min) {
+    d.type = DIST_UNIFORM;
+  } else if(sscanf(spec, "exp:%d:%lf", &d.min, &d.mean) == 2 && d.mean > d.min) {
+    d.type = DIST_EXPONENTIAL;
+  } else if(sscanf(spec, "erlang:%d:%lf:%d", &d.min, &d.mean, &d.k) == 3 && d.mean > d.min
+      && d.k > 0 && d.k <= RNG_BATCH) {
+    d.type = DIST_ERLANG;
+  } else {
+    return 0;
+  }
+  if(d.min < 0) return 0;
+  *dist = d;
+  return 1;
+}
+
+// Map an arrival log, returns NULL on error
+// The mapping lives for the rest of the process and is never copied
+ArrivalLog* arrivalLogOpen(const char* path) {
+  ArrivalLog* log;
+  struct stat st;
+  void* data;
+  int fd = open(path, O_RDONLY);
+  if(fd < 0 || fstat(fd, &st) != 0) {
+    perror(path);
+    if(fd >= 0) close(fd);
+    return NULL;
+  }
+  if(st.st_size == 0) {
+    fprintf(stderr, "%s: empty arrival log\n", path);
+    close(fd);
+    return NULL;
+  }
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // Mapping stays valid
+  if(data == MAP_FAILED) {
+    perror(path);
+    return NULL;
+  }
+  madvise(data, st.st_size, MADV_SEQUENTIAL); // Read once front to back
+  log = (ArrivalLog*)malloc(sizeof(ArrivalLog));
+  assert(log != NULL);
+  log->data = (const char*)data;
+  log->len = st.st_size;
+  log->binary = log->len >= 8 && memcmp(log->data, ARRIVAL_MAGIC, 8) == 0;
+  log->start = log->binary ? 8 : 0;
+  if(log->binary && (log->len - log->start) % sizeof(ArrivalRecord) != 0) {
+    fprintf(stderr, "%s: truncated arrival record\n", path);
+    munmap(data, log->len);
+    free(log);
+    return NULL;
+  }
+  return log;
+}
+
+// Decimal at data[*pos] moving *pos past it, returns -1 if there is none
+static int logInt(const ArrivalLog* log, size_t* pos) {
+  int value = 0;
+  int digits = 0;
+  while(*pos < log->len && log->data[*pos] >= '0' && log->data[*pos] <= '9') {
+    value = value * 10 + (log->data[*pos] - '0');
+    (*pos)++;
+    digits++;
+  }
+  return digits > 0 ? value : -1;
+}
+
+// Next record of a log from *pos, returns 0 at end of log
+int logNext(const ArrivalLog* log, size_t* pos, int* secs, int* service) {
+  const ArrivalRecord* rec;
+  if(log->binary) {
+    if(*pos + sizeof(ArrivalRecord) > log->len) return 0;
+    rec = (const ArrivalRecord*)(log->data + *pos);
+    *secs = rec->secs;
+    *service = rec->service;
+    *pos += sizeof(ArrivalRecord);
+    return 1;
+  }
+  while(*pos < log->len) {
+    *secs = logInt(log, pos);
+    *service = -1;
+    if(*secs >= 0 && *pos < log->len && log->data[*pos] == ',') {
+      (*pos)++;
+      *service = logInt(log, pos);
+    }
+    while(*pos < log->len && log->data[(*pos)++] != '\n'); // Rest of line
+    if(*secs >= 0) return 1; // Otherwise blank, comment or header line
+  }
+  return 0;
+}
+
+// Start a day's arrivals, sampled or replayed from cfg.arrivalLog
+void sourceInit(ArrivalSource* src, Config* cfg, unsigned int replication) {
+  samplerInit(&src->arrivals, &cfg->arrive, cfg->seed, replication, STREAM_ARRIVAL);
+  samplerInit(&src->services, &cfg->service, cfg->seed, replication, STREAM_SERVICE);
+  src->log = cfg->arrivalLog;
+  src->pos = src->log != NULL ? src->log->start : 0;
+  src->last = 0;
+  src->service = 0;
+}
+
+// Gap until the next customer arrives, sets src->service to their transaction
+// time, returns 0 once a replayed log has run out
+int sourceNext(ArrivalSource* src, int* gap) {
+  int secs;
+  int service;
+  int drawn;
+  if(src->log == NULL) {
+    *gap = sampleNext(&src->arrivals);
+    src->service = sampleNext(&src->services);
+    return 1;
+  }
+  if(!logNext(src->log, &src->pos, &secs, &service)) return 0;
+  *gap = secs > src->last ? secs - src->last : 0; // Out of order entries arrive together
+  if(secs > src->last) src->last = secs;
+  drawn = sampleNext(&src->services); // Keeps customer n on service draw n either way
+  src->service = service >= 0 ? service : drawn;
+  return 1;
+}
+
+// File timer into the wheel level/slot for its distance from now
+// Caller holds clock lock
+void addTimer(ClockSim* clock, Timer* timer) {
+  int delta = timer->deadline - clock->secs;
+  int level = 0;
+  int slot;
+  while(level < WHEEL_LEVELS - 1 && delta >= (1 << (WHEEL_BITS * (level + 1)))) level++;
+  slot = (timer->deadline >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+  timer->next = clock->wheel[level][slot];
+  clock->wheel[level][slot] = timer;
+}
+
+// Advance wheel to clock->secs, waking every timer that is now due
+// Caller holds clock lock
+void expireTimers(ClockSim* clock) {
+  Timer* timer;
+  Timer* next;
+  int level;
+  int slot;
+
+  // Cascade higher levels down whenever the lower level wraps
+  for(level = 1; level < WHEEL_LEVELS; level++) {
+    if((clock->secs & ((1 << (WHEEL_BITS * level)) - 1)) != 0) break;
+  }
+  for(level--; level >= 1; level--) {
+    slot = (clock->secs >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+    timer = clock->wheel[level][slot];
+    clock->wheel[level][slot] = NULL;
+    for(; timer != NULL; timer = next) {
+      next = timer->next;
+      addTimer(clock, timer);
+    }
+  }
+
+  slot = clock->secs & (WHEEL_SLOTS - 1);
+  timer = clock->wheel[0][slot];
+  clock->wheel[0][slot] = NULL;
+  for(; timer != NULL; timer = next) {
+    next = timer->next; // Waiter may return as soon as it is signalled
+    if(timer->deadline > clock->secs) {
+      addTimer(clock, timer); // Shares slot but due a lap later
+      continue;
+    }
+    timer->fired = 1;
+    pthread_cond_signal(&timer->wake);
+  }
+}
+
+// Block until the simulated clock reaches deadline
+void sleepUntil(ClockSim* clock, int deadline) {
+  Timer timer;
+  pthread_mutex_lock(&clock->lock);
+  if(deadline > clock->secs) {
+    timer.deadline = deadline;
+    timer.fired = 0;
+    pthread_cond_init(&timer.wake, NULL);
+    addTimer(clock, &timer);
+    while(!timer.fired) pthread_cond_wait(&timer.wake, &clock->lock);
+    pthread_cond_destroy(&timer.wake);
+  }
+  pthread_mutex_unlock(&clock->lock);
+}
+
+// Parameters the original assignment ran with
+void configDefaults(Config* cfg) {
+  cfg->tellers = TELLER_NUM;
+  cfg->openHours = OPEN_HOURS;
+  cfg->tickNs = TICK_NS;
+#ifdef __QNX__
+  cfg->tickBackend = TICK_PULSE;
+#else
+  cfg->tickBackend = TICK_NANOSLEEP;
+#endif
+  cfg->useWheel = 1;
+  cfg->lockFree = 0;
+  cfg->catchUp = 0;
+  cfg->discipline = DISC_SHARED;
+  cfg->seed = 1;
+  cfg->arrivalLog = NULL;
+  cfg->transferDepth = 4;
+  cfg->transferSecs = 300;
+  parseDist("uniform:60:240", &cfg->arrive);
+  parseDist("uniform:30:360", &cfg->service);
+}
+
+// Set one parameter by name, returns 0 if key or value is bad
+int configSet(Config* cfg, const char* key, const char* value) {
+  if(strcmp(key, "tellers") == 0) {
+    cfg->tellers = atoi(value);
+    return cfg->tellers > 0;
+  }
+  if(strcmp(key, "hours") == 0) {
+    cfg->openHours = atoi(value);
+    return cfg->openHours > 0;
+  }
+  if(strcmp(key, "tick_ns") == 0) {
+    cfg->tickNs = atol(value);
+    return cfg->tickNs > 0 && cfg->tickNs < 1000000000L;
+  }
+  if(strcmp(key, "tick") == 0) {
+    if(strcmp(value, "pulse") == 0) cfg->tickBackend = TICK_PULSE;
+    else if(strcmp(value, "nanosleep") == 0) cfg->tickBackend = TICK_NANOSLEEP;
+    else if(strcmp(value, "timerfd") == 0) cfg->tickBackend = TICK_TIMERFD;
+    else return 0;
+    return 1;
+  }
+  if(strcmp(key, "wake") == 0) {
+    if(strcmp(value, "wheel") == 0) cfg->useWheel = 1;
+    else if(strcmp(value, "broadcast") == 0) cfg->useWheel = 0;
+    else return 0;
+    return 1;
+  }
+  if(strcmp(key, "queue") == 0) {
+    if(strcmp(value, "mutex") == 0) cfg->lockFree = 0;
+    else if(strcmp(value, "lockfree") == 0) cfg->lockFree = 1;
+    else return 0;
+    return 1;
+  }
+  if(strcmp(key, "catchup") == 0) {
+    if(strcmp(value, "on") == 0) cfg->catchUp = 1;
+    else if(strcmp(value, "off") == 0) cfg->catchUp = 0;
+    else return 0;
+    return 1;
+  }
+  if(strcmp(key, "discipline") == 0) {
+    if(strcmp(value, "shared") == 0) cfg->discipline = DISC_SHARED;
+    else if(strcmp(value, "jsq") == 0) cfg->discipline = DISC_JSQ;
+    else if(strcmp(value, "rr") == 0) cfg->discipline = DISC_RR;
+    else return 0;
+    return 1;
+  }
+  if(strcmp(key, "seed") == 0) {
+    cfg->seed = strtoull(value, NULL, 0);
+    return 1;
+  }
+  if(strcmp(key, "arrival") == 0) return parseDist(value, &cfg->arrive);
+  if(strcmp(key, "service") == 0) return parseDist(value, &cfg->service);
+  if(strcmp(key, "transfer_depth") == 0) {
+    cfg->transferDepth = atoi(value);
+    return cfg->transferDepth > 0;
+  }
+  if(strcmp(key, "transfer_secs") == 0) {
+    cfg->transferSecs = atoi(value);
+    return cfg->transferSecs > 0;
+  }
+  if(strcmp(key, "arrival_log") == 0) {
+    cfg->arrivalLog = arrivalLogOpen(value);
+    return cfg->arrivalLog != NULL;
+  }
+  return 0;
+}
+
+// Read "key = value" lines into cfg, # starts a comment, returns 0 on error
+int loadConfig(Config* cfg, const char* path) {
+  FILE* file = fopen(path, "r");
+  char line[256];
+  char key[64];
+  char value[128];
+  char* hash;
+  int lineNum = 0;
+  if(file == NULL) {
+    perror(path);
+    return 0;
+  }
+  while(fgets(line, sizeof(line), file) != NULL) {
+    lineNum++;
+    hash = strchr(line, '#');
+    if(hash != NULL) *hash = '\0';
+    if(sscanf(line, " %63[^= \t] = %127s", key, value) != 2) {
+      if(sscanf(line, " %63s", key) == 1) {
+        fprintf(stderr, "%s:%d: expected key = value\n", path, lineNum);
+        fclose(file);
+        return 0;
+      }
+      continue; // Blank or comment only
+    }
+    if(!configSet(cfg, key, value)) {
+      fprintf(stderr, "%s:%d: bad setting %s = %s\n", path, lineNum, key, value);
+      fclose(file);
+      return 0;
+    }
+  }
+  fclose(file);
+  return 1;
+}
+
+// Block for waitTime fake seconds
+void simWait(Bank* b, unsigned int waitTime) {
+  int deadline = clockNow(&b->clock) + waitTime;
+  if(b->clock.useWheel) {
+    sleepUntil(&b->clock, deadline);
+    return;
+  }
+  // Wait for the deadline rather than counting ticks, a catching up clock
+  // covers several seconds with one broadcast
+  pthread_mutex_lock(&b->clock.lock);
+  while(clockNow(&b->clock) < deadline) {
+    pthread_cond_wait(&b->clock.tick, &b->clock.lock); //wait for sim clock tick
+  }
+  pthread_mutex_unlock(&b->clock.lock);
+}
+
+// Histogram bucket holding value
+int histBucket(int value) {
+  int shift = 0;
+  if(value < HIST_SUB) return value < 0 ? 0 : value;
+  while((value >> shift) >= 2 * HIST_SUB) shift++;
+  return (shift + 1) * HIST_SUB + (value >> shift) - HIST_SUB;
+}
+
+// Largest value that lands in bucket
+int histBucketTop(int bucket) {
+  int shift;
+  if(bucket < HIST_SUB) return bucket;
+  shift = bucket / HIST_SUB - 1;
+  return (int)((((long long)(bucket % HIST_SUB + HIST_SUB) + 1) << shift) - 1);
+}
+
+// Add one sample
+void metricRecord(Metric* metric, int value) {
+  metric->count++;
+  metric->sum += value;
+  if(value > metric->max) metric->max = value;
+  metric->hist[histBucket(value)]++;
+}
+
+// Fold src into dst
+void metricMerge(Metric* dst, Metric* src) {
+  int i;
+  dst->count += src->count;
+  dst->sum += src->sum;
+  if(src->max > dst->max) dst->max = src->max;
+  for(i = 0; i < HIST_BUCKETS; i++) dst->hist[i] += src->hist[i];
+}
+
+// Average sample, 0 when empty
+double metricAvg(Metric* metric) {
+  return metric->count ? (double)metric->sum / metric->count : 0;
+}
+
+// Value at percentile pct (0-100), accurate to the bucket width
+int metricPercentile(Metric* metric, double pct) {
+  long rank = (long)(metric->count * pct / 100.0 + 0.5);
+  long seen = 0;
+  int i;
+  if(rank < 1) rank = 1;
+  for(i = 0; i < HIST_BUCKETS; i++) {
+    seen += metric->hist[i];
+    if(seen >= rank) {
+      return histBucketTop(i) < metric->max ? histBucketTop(i) : metric->max;
+    }
+  }
+  return metric->max;
+}
+
+// Start an empty line
+void dequeInit(Deque* line) {
+  pthread_mutex_init(&line->lock, NULL);
+  line->cap = LINE_SIZE;
+  line->custs = (Customer**)malloc(line->cap * sizeof(Customer*));
+  assert(line->custs != NULL);
+  line->head = 0;
+  line->depth = 0;
+}
+
+// Release a line's storage
+void dequeFree(Deque* line) {
+  pthread_mutex_destroy(&line->lock);
+  free(line->custs);
+  line->custs = NULL;
+}
+
+// Release the per-teller arrays
+void bankFree(Bank* b) {
+  int i;
+  for(i = 0; i < b->tellersAllocated; i++) dequeFree(&b->tellers[i].line);
+  free(b->tellers);
+  free(b->tellerStats);
+  b->tellers = NULL;
+  b->tellerStats = NULL;
+  b->tellersAllocated = 0;
+}
+
+// Size the per-teller arrays for cfg.tellers and empty every teller line
+void bankSetup(Bank* b) {
+  int i;
+  if(b->tellersAllocated != b->cfg.tellers) {
+    bankFree(b);
+    b->tellers = (Teller*)cacheAlloc(b->cfg.tellers * sizeof(Teller));
+    b->tellerStats = (TellerStats*)cacheAlloc(b->cfg.tellers * sizeof(TellerStats));
+    assert(b->tellers != NULL && b->tellerStats != NULL);
+    for(i = 0; i < b->cfg.tellers; i++) dequeInit(&b->tellers[i].line);
+    b->tellersAllocated = b->cfg.tellers;
+  }
+  for(i = 0; i < b->cfg.tellers; i++) {
+    b->tellers[i].line.head = 0;
+    b->tellers[i].line.depth = 0;
+  }
+  b->customers.nextLine = 0;
+}
+
+// Clear every accumulator for a new day
+void resetStats(Bank* b) {
+  memset(b->tellerStats, 0, b->cfg.tellers * sizeof(TellerStats));
+  memset(&b->depth, 0, sizeof(Metric));
+}
+
+// Start an empty pool
+void poolInit(CustomerPool* pool) {
+  pthread_mutex_init(&pool->lock, NULL);
+  pool->slabs = NULL;
+  pool->depot = NULL;
+  pool->depotCount = 0;
+  pool->allocs = 0;
+  pool->slabAllocs = 0;
+}
+
+// Start an empty per-thread cache
+void poolCacheInit(PoolCache* cache) {
+  memset(cache, 0, sizeof(PoolCache));
+}
+
+// Hand out an uninitialised customer record
+Customer* poolAlloc(CustomerPool* pool, PoolCache* cache) {
+  Customer* cust;
+  int i;
+  if(cache->free == NULL && __atomic_load_n(&pool->depotCount, __ATOMIC_RELAXED) > 0) { // Unlocked peek, rechecked below
+    // Take a batch other threads have finished with
+    pthread_mutex_lock(&pool->lock);
+    for(i = 0; i < POOL_BATCH && pool->depot != NULL; i++) {
+      cust = pool->depot;
+      pool->depot = cust->next;
+      __atomic_store_n(&pool->depotCount, pool->depotCount - 1, __ATOMIC_RELAXED);
+      cust->next = cache->free;
+      if(cache->free == NULL) cache->freeTail = cust;
+      cache->free = cust;
+      cache->freeCount++;
     }
+    pthread_mutex_unlock(&pool->lock);
+  }
+  cache->allocs++;
+  if(cache->free != NULL) {
+    cust = cache->free;
+    cache->free = cust->next;
+    cache->freeCount--;
+    return cust;
+  }
+  if(cache->slab == NULL || cache->slabUsed == POOL_SLAB) {
+    cache->slab = (Slab*)malloc(sizeof(Slab));
+    assert(cache->slab != NULL);
+    cache->slabUsed = 0;
+    pthread_mutex_lock(&pool->lock);
+    cache->slab->next = pool->slabs;
+    pool->slabs = cache->slab;
+    pool->slabAllocs++;
+    pthread_mutex_unlock(&pool->lock);
+  }
+  return &cache->slab->custs[cache->slabUsed++];
+}
+
+// Return customer to the calling thread's cache, spilling a batch to the depot when full
+void poolFree(CustomerPool* pool, PoolCache* cache, Customer* cust) {
+  cust->next = cache->free;
+  if(cache->free == NULL) cache->freeTail = cust;
+  cache->free = cust;
+  if(++cache->freeCount < 2 * POOL_BATCH) return;
+  pthread_mutex_lock(&pool->lock);
+  cache->freeTail->next = pool->depot;
+  pool->depot = cache->free;
+  __atomic_store_n(&pool->depotCount, pool->depotCount + cache->freeCount, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&pool->lock);
+  cache->free = NULL;
+  cache->freeTail = NULL;
+  cache->freeCount = 0;
+}
+
+// Fold a finished thread's counters into the pool
+void poolCacheDone(CustomerPool* pool, PoolCache* cache) {
+  pthread_mutex_lock(&pool->lock);
+  pool->allocs += cache->allocs;
+  pthread_mutex_unlock(&pool->lock);
+  cache->allocs = 0;
+}
+
+// Release every customer of the day at once
+// No cache may be used again afterwards
+void poolRelease(CustomerPool* pool) {
+  Slab* slab;
+  while(pool->slabs != NULL) {
+    slab = pool->slabs;
+    pool->slabs = slab->next;
+    free(slab);
+  }
+  pool->depot = NULL;
+  __atomic_store_n(&pool->depotCount, 0, __ATOMIC_RELAXED);
+}
+
+// Remove next node for queue and return it
+Customer* dequeue(Queue* queue) {
+  Customer* head = queue->head;
+  if(head != NULL) {
+    queue->head = head->next;
+    if(queue->head == NULL) queue->tail = NULL;
+    queue->depth--;
     head->next = NULL;
   }
   return head;
 }
 
-// Add node to end of queue
-int enqueue(Customer* cust, Customer** queue) {
+// Add node to end of queue, returns new queue depth
+int enqueue(Customer* cust, Queue* queue) {
   if(cust == NULL) return 0;
-  Customer* tail = findTail(*queue);
-  if(tail == NULL) {
-    cust->depth = 1;
-    *queue = cust;
+  cust->next = NULL;
+  if(queue->tail == NULL) {
+    queue->head = cust;
   } else {
-    cust->depth = tail->depth+1;
-    tail->next = cust;
+    queue->tail->next = cust;
   }
-  return cust->depth;
+  queue->tail = cust;
+  return ++queue->depth;
 }
 
-// dequeue with mutex guarding access and line stat logic
-Customer* getNextCust() {
-  Customer* nextCust = NULL;
-  pthread_mutex_lock(&bank.customers.lock);
-  nextCust = dequeue(&bank.customers.q);
-  pthread_mutex_unlock(&bank.customers.lock);
-  return nextCust;
+// Reset ring to empty
+void ringInit(Ring* ring) {
+  unsigned int i;
+  ring->enqPos = 0;
+  ring->deqPos = 0;
+  ring->depth = 0;
+  for(i = 0; i < RING_SIZE; i++) {
+    ring->slots[i].seq = i;
+    ring->slots[i].cust = NULL;
+  }
 }
 
-// enqueue with mutex guarding access and line stat logic
-void addCustomer(Customer* newCust) {
-  if(newCust == NULL) return;
-  pthread_mutex_lock(&bank.customers.lock);
-  enqueue(newCust, &bank.customers.q);
-  newCust->startingDepth = newCust->depth; // Set starting depth for customer
-  pthread_mutex_unlock(&bank.customers.lock);
-  sem_post(&bank.customers.semaphore);
+// Lock-free add to ring, returns new depth or 0 if ring is full
+int ringPush(Ring* ring, Customer* cust) {
+  RingSlot* slot;
+  unsigned int pos = __atomic_load_n(&ring->enqPos, __ATOMIC_RELAXED);
+  unsigned int seq;
+  int diff;
+  int depth;
+  for(;;) {
+    slot = &ring->slots[pos & (RING_SIZE - 1)];
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    diff = (int)(seq - pos);
+    if(diff == 0) {
+      if(__atomic_compare_exchange_n(&ring->enqPos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+    } else if(diff < 0) {
+      return 0;
+    } else {
+      pos = __atomic_load_n(&ring->enqPos, __ATOMIC_RELAXED);
+    }
+  }
+  slot->cust = cust;
+  depth = __atomic_add_fetch(&ring->depth, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+  return depth;
 }
 
-// Teller thread function
-void* teller(void* arg) {
-  unsigned int wait = 0;
-  unsigned int seed = 12;
-  int startWait = 0;
-  int endWait = 0;
-  unsigned int lowBoundWait = 30;
-  unsigned int upperBoundWait = 60 * 6;
-
-  Customer* cur = NULL;
+// Lock-free remove from ring, returns NULL if ring is empty
+Customer* ringPop(Ring* ring) {
+  RingSlot* slot;
+  Customer* cust;
+  unsigned int pos = __atomic_load_n(&ring->deqPos, __ATOMIC_RELAXED);
+  unsigned int seq;
+  int diff;
   for(;;) {
-    startWait = bank.clock.secs;
-    sem_wait(&bank.customers.semaphore);
-    endWait = bank.clock.secs;
-    cur = getNextCust();
-    if(cur == NULL) {
-      break;
+    slot = &ring->slots[pos & (RING_SIZE - 1)];
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    diff = (int)(seq - (pos + 1));
+    if(diff == 0) {
+      if(__atomic_compare_exchange_n(&ring->deqPos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+    } else if(diff < 0) {
+      return NULL;
+    } else {
+      pos = __atomic_load_n(&ring->deqPos, __ATOMIC_RELAXED);
     }
-    cur->endWaitTime = bank.clock.secs;
-    wait = randomWait(lowBoundWait, upperBoundWait, &seed, cur); // Sim transaction
+  }
+  cust = slot->cust;
+  __atomic_sub_fetch(&ring->depth, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->seq, pos + RING_SIZE, __ATOMIC_RELEASE);
+  return cust;
+}
 
-    // Set stats for transaction
-    cur->endWaitTime = bank.clock.secs;
-    cur->transTime = wait;
-    cur->tellWaitTime = endWait - startWait;
-    enqueue(cur, &bank.served); // Add to served queue
+// Add customer to back of line, growing it when full, returns new depth
+int dequePush(Deque* line, Customer* cust) {
+  Customer** custs;
+  int depth;
+  int i;
+  pthread_mutex_lock(&line->lock);
+  if(line->depth == line->cap) {
+    custs = (Customer**)malloc(2 * line->cap * sizeof(Customer*));
+    assert(custs != NULL);
+    for(i = 0; i < line->depth; i++) custs[i] = line->custs[(line->head + i) & (line->cap - 1)];
+    free(line->custs);
+    line->custs = custs;
+    line->cap *= 2;
+    line->head = 0;
   }
+  line->custs[(line->head + line->depth) & (line->cap - 1)] = cust;
+  depth = line->depth + 1;
+  __atomic_store_n(&line->depth, depth, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&line->lock);
+  return depth;
 }
 
-// Customer generation thread function
-void* customerGen(void) {
-  int id = 1;
-  int stopGenerating = 0;
-  unsigned int seed = 42;
-  unsigned int lowerBoundWait = 60;
-  unsigned int upperBoundWait = 4 * 60;
+// Take customer from front (owner) or back (thief) of line, returns NULL if empty
+Customer* dequePop(Deque* line, int fromBack) {
   Customer* cust = NULL;
-  for(;;) {
-    pthread_mutex_lock(&bank.lock);
-    stopGenerating = bank.closed;
-    pthread_mutex_unlock(&bank.lock);
-    if(stopGenerating) break;
-    cust = (Customer*)malloc(sizeof(Customer));
-    pthread_mutex_init(&cust->wait, NULL);
-    randomWait(lowerBoundWait, upperBoundWait, &seed, cust);
-    cust->id = id;
-    addCustomer(cust);
-    cust->startWaitTime = bank.clock.secs;
-    id++;
+  pthread_mutex_lock(&line->lock);
+  if(line->depth > 0) {
+    if(fromBack) {
+      cust = line->custs[(line->head + line->depth - 1) & (line->cap - 1)];
+    } else {
+      cust = line->custs[line->head];
+      line->head = (line->head + 1) & (line->cap - 1);
+    }
+    __atomic_store_n(&line->depth, line->depth - 1, __ATOMIC_RELAXED);
   }
+  pthread_mutex_unlock(&line->lock);
+  return cust;
 }
 
-// Bank simulation thread function
-void* bankClock(int* closingTime) {
-  struct _pulse pulse;
-  int pid;
-  int chid;
-  int pulse_id = 0;
-  timer_t timer_id;
-  struct sigevent event;
-  struct itimerspec timer;
-  struct _clockperiod clkper;
-  struct sched_param param;
-  int ret;
+// Put arriving customer in a teller's line per cfg.discipline, returns its depth
+int joinLine(Bank* b, Customer* cust) {
+  int best = 0;
+  int bestDepth;
+  int depth;
+  int i;
+  if(b->cfg.discipline == DISC_RR) {
+    best = b->customers.nextLine; // Generator is the only writer
+    b->customers.nextLine = (best + 1) % b->cfg.tellers;
+  } else {
+    bestDepth = __atomic_load_n(&b->tellers[0].line.depth, __ATOMIC_RELAXED);
+    for(i = 1; i < b->cfg.tellers && bestDepth > 0; i++) {
+      depth = __atomic_load_n(&b->tellers[i].line.depth, __ATOMIC_RELAXED);
+      if(depth < bestDepth) {
+        best = i;
+        bestDepth = depth;
+      }
+    }
+  }
+  return dequePush(&b->tellers[best].line, cust);
+}
 
-  param.sched_priority = sched_get_priority_max( SCHED_RR );
-  ret = sched_setscheduler( 0, SCHED_RR, &param);
-  assert ( ret != -1 ); // if returns a -1 for failure we stop with error
+// Next customer for teller id, from its own line or else stolen from the
+// back of the longest other line, returns NULL if every line looked empty
+Customer* leaveLine(Bank* b, int id) {
+  Customer* cust = dequePop(&b->tellers[id].line, 0);
+  int victim = -1;
+  int most = 0;
+  int depth;
+  int i;
+  if(cust != NULL) return cust;
+  for(i = 0; i < b->cfg.tellers; i++) {
+    if(i == id) continue;
+    depth = __atomic_load_n(&b->tellers[i].line.depth, __ATOMIC_RELAXED);
+    if(depth > most) {
+      victim = i;
+      most = depth;
+    }
+  }
+  if(victim < 0) return NULL;
+  return dequePop(&b->tellers[victim].line, 1);
+}
 
-  clkper.nsec = 100000;
-  clkper.fract = 0;
-  ClockPeriod ( CLOCK_REALTIME, &clkper, NULL, 0 );
+// Cycle counter for trace records, cheap enough to read on every event
+static inline uint64_t traceStamp() {
+#ifdef __QNX__
+  return ClockCycles();
+#elif defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return nowNanos();
+#endif
+}
 
-  chid = ChannelCreate( 0 );
-  event.sigev_notify = SIGEV_PULSE;   // most basic message we can send -- just a pulse number
-  event.sigev_coid = ConnectAttach ( ND_LOCAL_NODE, 0, chid, 0, 0 );  // Get ID that allows me to communicate on the channel
-  assert ( event.sigev_coid != -1 );    // stop with error if cannot attach to channel
-  event.sigev_priority = getprio(0);
-  event.sigev_code = 1023;        // arbitrary number assigned to this pulse
-  event.sigev_value.sival_ptr = (void*)pulse_id;
-  if ( timer_create( CLOCK_REALTIME, &event, &timer_id ) == -1 )  // CLOCK_REALTIME available in all POSIX systems
-  {
-    perror ( "cannot create timer" );
-    exit( EXIT_FAILURE );
-  }
-  timer.it_value.tv_sec = 0;
-  timer.it_value.tv_nsec = 1700000; //roughly one fake second
-  timer.it_interval.tv_sec = 0;
-  timer.it_interval.tv_nsec = 1700000;
-  /* Start the timer. */
-  if ( timer_settime( timer_id, 0, &timer, NULL ) == -1 )
-  {
-    perror("Cannot start timer.\n");
-    exit( EXIT_FAILURE );
-  }
-  for(;;) {
-    if(bank.clock.kill) break;
-    pid = MsgReceivePulse (chid, &pulse, sizeof( pulse ), NULL);
-    bank.clock.secs++;
-    pthread_cond_broadcast(&bank.clock.tick);
-    if(bank.clock.secs > *closingTime) pthread_cond_signal(&bank.open);
+// Map the next window of the trace file, returns 0 on failure
+int traceMap(Trace* trace) {
+  if(ftruncate(trace->fd, trace->windowOff + TRACE_WINDOW) != 0) return 0;
+  trace->window = (char*)mmap(NULL, TRACE_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED,
+    trace->fd, trace->windowOff);
+  if(trace->window == MAP_FAILED) {
+    trace->window = NULL;
+    return 0;
   }
+  trace->windowUsed = 0;
+  return 1;
 }
 
-// Bank simulation thread function
-void* runBank() {
-  pthread_cond_init(&bank.open, NULL);
-  pthread_mutex_init(&bank.wait, NULL);
-
-  printf("Bank opening\n");
-  pthread_mutex_lock(&bank.wait);
-  pthread_cond_wait(&bank.open, &bank.wait);
-  pthread_mutex_unlock(&bank.wait);
-  pthread_mutex_lock(&bank.lock);
-  bank.closed = 1;
-  pthread_mutex_unlock(&bank.lock);
-  printf("Bank Closing\n");
-  int i = 0;
-  for(i = 0; i < TELLER_NUM; i++) {
-    sem_post(&bank.customers.semaphore);
+// Copy n records into the file, moving the window along as it fills
+void traceWrite(Trace* trace, TraceRecord* recs, unsigned int n) {
+  size_t bytes;
+  while(n > 0 && trace->window != NULL) {
+    if(trace->windowUsed == TRACE_WINDOW) {
+      munmap(trace->window, TRACE_WINDOW);
+      trace->windowOff += TRACE_WINDOW;
+      if(!traceMap(trace)) {
+        perror("trace");
+        return;
+      }
+    }
+    bytes = n * sizeof(TraceRecord);
+    if(bytes > TRACE_WINDOW - trace->windowUsed) bytes = TRACE_WINDOW - trace->windowUsed;
+    memcpy(trace->window + trace->windowUsed, recs, bytes);
+    trace->windowUsed += bytes;
+    trace->header.records += bytes / sizeof(TraceRecord);
+    recs += bytes / sizeof(TraceRecord);
+    n -= bytes / sizeof(TraceRecord);
   }
 }
 
-void openBank() {
-  // Init bank vars
-  bank.clock.kill = 0;
-  bank.closed = 0;
-  bank.clock.secs = 0;
-  int openTimeSecs = OPEN_HOURS * 60 * 60;
-  pthread_cond_init(&bank.clock.tick, NULL);
-  pthread_mutex_init(&bank.customers.lock, NULL);
-  pthread_mutex_init(&bank.lock, NULL);
-  pthread_mutex_init(&bank.clock.lock, NULL);
-  sem_init(&bank.customers.semaphore, 0, 0);
+// Move everything the writers have published into the file
+// Only the drain thread (or the closer, once it has stopped) calls this
+void traceDrain(Trace* trace) {
+  TraceRing* ring;
+  unsigned int head;
+  unsigned int tail;
+  unsigned int n;
+  int writers = __atomic_load_n(&trace->writers, __ATOMIC_ACQUIRE);
+  int i;
+  if(writers > TRACE_WRITERS) writers = TRACE_WRITERS;
+  for(i = 0; i < writers; i++) {
+    ring = __atomic_load_n(&trace->rings[i], __ATOMIC_ACQUIRE);
+    if(ring == NULL) continue; // Claimed but not published yet
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    tail = ring->tail;
+    while(tail != head) {
+      // Contiguous run up to head or the end of the ring
+      n = head - tail;
+      if(n > TRACE_RING - (tail & (TRACE_RING - 1))) n = TRACE_RING - (tail & (TRACE_RING - 1));
+      traceWrite(trace, &ring->recs[tail & (TRACE_RING - 1)], n);
+      tail += n;
+    }
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+  }
+}
 
-  // Set lower priority for threads
-  pthread_attr_t threadAttributes ;
-  int policy;
-  struct sched_param parameters ;
-  pthread_attr_init(&threadAttributes) ;    // initialize thread attributes structure -- must do before any other activity on this struct
-  pthread_getschedparam(pthread_self(), &policy, &parameters) ; // get this main thread's scheduler parameters
-  parameters.sched_priority--;                  // lower the priority
-  pthread_attr_setschedparam(&threadAttributes, &parameters) ;  // set up the pthread_attr struct with the updated priority
+// Trace drain thread function, empties the rings every millisecond
+void* traceDrainer(void* arg) {
+  Trace* trace = (Trace*)arg;
+  struct timespec pause = {0, 1000000};
+  while(!__atomic_load_n(&trace->kill, __ATOMIC_ACQUIRE)) {
+    traceDrain(trace);
+    nanosleep(&pause, NULL);
+  }
+  return NULL;
+}
 
-  pthread_create(&bank.clock.thread, NULL, &bankClock, &openTimeSecs); // Start sim clock
-  pthread_create(&bank.thread, &threadAttributes, &runBank, NULL); // Start bank
-  int i;
-  for(i = 0; i < TELLER_NUM; i++) {
-    pthread_create(&bank.tellers[i], &threadAttributes, &teller, i+1); // Start tellers
+// Create trace file at path and start draining into it, returns NULL on failure
+Trace* traceOpen(const char* path) {
+  Trace* trace = (Trace*)calloc(1, sizeof(Trace));
+  assert(trace != NULL);
+  trace->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(trace->fd < 0) {
+    perror(path);
+    free(trace);
+    return NULL;
+  }
+  trace->windowOff = TRACE_DATA_OFFSET;
+  if(!traceMap(trace)) {
+    perror(path);
+    close(trace->fd);
+    free(trace);
+    return NULL;
   }
-  pthread_create(&bank.customers.thread, &threadAttributes, &customerGen, NULL); // Start customer generation
+  trace->header.magic = TRACE_MAGIC;
+  trace->header.version = TRACE_VERSION;
+  trace->header.recordSize = sizeof(TraceRecord);
+  trace->header.nsStart = nowNanos();
+  trace->header.tscStart = traceStamp();
+  pthread_create(&trace->thread, NULL, &traceDrainer, trace);
+  return trace;
 }
 
-// Wait till teller threads have finished and kill clock thread
-void closeBank() {
-  int i;
-  for(i = 0; i < TELLER_NUM; i++) {
-    pthread_join(bank.tellers[i], NULL);
-  }
-  bank.clock.kill = 1;
-}
-
-void stats() {
-  int maxDepth = 0;
-  int maxTransTime = 0;
-  int numServed = 0;
-  int tmpCustWait = 0;
-  int maxCustWait = 0;
-  int totalCustWait = 0;
-  int totalTransTime = 0;
-  int maxTelWait = 0;
-  int totalTelWait = 0;
-  Customer* cust = bank.served;
-  Customer* tmp = NULL;
-  for(;;) {
-    if(cust == NULL) break;
-    if(cust->startingDepth > maxDepth) maxDepth = cust->startingDepth;
-    if(maxTransTime < cust->transTime) maxTransTime = cust->transTime;
-    if(maxTelWait < cust->tellWaitTime) maxTelWait = cust->tellWaitTime;
-    tmpCustWait = cust->endWaitTime - cust->startWaitTime;
-    totalCustWait += tmpCustWait;
-    if(maxCustWait < tmpCustWait) maxCustWait = tmpCustWait;
-    totalTransTime += cust->transTime;
-    numServed++;
-    totalTelWait += cust->tellWaitTime;
-    if(cust->next == NULL) break;
-    tmp = cust;
-    cust = cust->next;
-    free(tmp);
-    tmp = NULL;
-  }
-  printf("Total customers served today: %d\n", numServed);
-  printf("The maximum queue depth was %d\n", maxDepth);
-  printf("The maximum teller transaction time was %d\n", maxTransTime);
-  printf("The average transaction time was: %d\n", totalTransTime/numServed);
-  printf("The maximum teller wait time was %d\n", maxTelWait);
-  printf("The average teller wait time was %d\n", totalTelWait/numServed);
-  printf("The maximum customer wait time was %d\n", maxCustWait);
-  printf("The average customer wait time was %d\n", totalCustWait/numServed);
+// Ring for the calling thread to record into, NULL if not tracing
+// block makes the thread wait for the drainer rather than drop records,
+// for the event engine where a stall costs no accuracy
+TraceRing* traceAttach(Trace* trace, int block) {
+  TraceRing* ring;
+  int i;
+  if(trace == NULL) return NULL;
+  i = __atomic_fetch_add(&trace->writers, 1, __ATOMIC_RELAXED);
+  if(i >= TRACE_WRITERS) return NULL;
+  ring = (TraceRing*)cacheAlloc(sizeof(TraceRing));
+  assert(ring != NULL);
+  ring->block = block;
+  __atomic_store_n(&trace->rings[i], ring, __ATOMIC_RELEASE);
+  return ring;
 }
 
-int main(int argc, char *argv[]) {
-  openBank();
-  closeBank();
-  stats();
+// Record one event, drops it (counted) if the ring is full and not blocking
+static inline void traceEvent(TraceRing* ring, int secs, TraceType type, int source, int custId, int arg) {
+  TraceRecord* rec;
+  unsigned int head;
+  if(ring == NULL) return;
+  head = ring->head;
+  while(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == TRACE_RING) {
+    if(!ring->block) {
+      ring->dropped++;
+      return;
+    }
+    sched_yield();
+  }
+  rec = &ring->recs[head & (TRACE_RING - 1)];
+  rec->tsc = traceStamp();
+  rec->secs = secs;
+  rec->type = type;
+  rec->source = source;
+  rec->custId = custId;
+  rec->arg = arg;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Mark the calling thread's ring as finished so traceClose can free it
+void traceDetach(TraceRing* ring) {
+  if(ring != NULL) __atomic_store_n(&ring->done, 1, __ATOMIC_RELEASE);
+}
+
+// Stop draining, write the header and trim the file, returns records written
+// Every engine has joined or finished its writers by now, so all rings are
+// detached; one that is not would be drained but left allocated rather than
+// freed under its writer
+uint64_t traceClose(Trace* trace) {
+  uint64_t records;
+  int writers;
+  int i;
+  __atomic_store_n(&trace->kill, 1, __ATOMIC_RELEASE);
+  pthread_join(trace->thread, NULL);
+  traceDrain(trace);
+  trace->header.tscEnd = traceStamp();
+  trace->header.nsEnd = nowNanos();
+  writers = trace->writers < TRACE_WRITERS ? trace->writers : TRACE_WRITERS;
+  trace->header.writers = writers;
+  for(i = 0; i < writers; i++) {
+    if(trace->rings[i] == NULL) continue;
+    trace->header.dropped += trace->rings[i]->dropped;
+    if(__atomic_load_n(&trace->rings[i]->done, __ATOMIC_ACQUIRE)) free(trace->rings[i]);
+  }
+  if(trace->window != NULL) munmap(trace->window, TRACE_WINDOW);
+  if(ftruncate(trace->fd, TRACE_DATA_OFFSET + trace->header.records * sizeof(TraceRecord)) != 0
+      || pwrite(trace->fd, &trace->header, sizeof(TraceHeader), 0) != sizeof(TraceHeader)) {
+    perror("trace");
+  }
+  close(trace->fd);
+  records = trace->header.records;
+  free(trace);
+  return records;
+}
+
+// Create (or take over) the shared memory object name and map it, NULL on failure
+// Monitors that already had it mapped see the fresh day from its zeroed state
+MetricsSegment* metricsOpen(const char* name, int tellers) {
+  MetricsSegment* m;
+  int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+  if(fd < 0) {
+    perror(name);
+    return NULL;
+  }
+  if(ftruncate(fd, sizeof(MetricsSegment)) != 0) {
+    perror(name);
+    close(fd);
+    return NULL;
+  }
+  m = (MetricsSegment*)mmap(NULL, sizeof(MetricsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd); // Mapping keeps the object alive
+  if(m == MAP_FAILED) {
+    perror(name);
+    return NULL;
+  }
+  __atomic_store_n(&m->magic, 0, __ATOMIC_RELAXED); // Readers ignore it while resetting
+  memset((char*)m + sizeof(m->magic), 0, sizeof(MetricsSegment) - sizeof(m->magic));
+  m->version = METRICS_VERSION;
+  m->size = sizeof(MetricsSegment);
+  m->tellers = tellers < METRICS_TELLERS ? tellers : METRICS_TELLERS;
+  m->pid = getpid();
+  __atomic_store_n(&m->magic, METRICS_MAGIC, __ATOMIC_RELEASE);
+  return m;
+}
+
+// Teller's slot, NULL when not publishing or past METRICS_TELLERS
+MetricsTeller* metricsTeller(MetricsSegment* m, int id) {
+  if(m == NULL || id >= m->tellers) return NULL;
+  return &m->teller[id];
+}
+
+// Teller went to the line for a customer
+static inline void metricsIdle(MetricsTeller* slot) {
+  if(slot == NULL) return;
+  metricsBegin(&slot->seq);
+  slot->state = MS_IDLE;
+  slot->custId = -1;
+  metricsEnd(&slot->seq);
+}
+
+// Teller took cust, who waited custWait
+static inline void metricsServe(MetricsTeller* slot, int custId, int custWait) {
+  if(slot == NULL) return;
+  metricsBegin(&slot->seq);
+  slot->state = MS_BUSY;
+  slot->custId = custId;
+  slot->started++;
+  slot->waitSum += custWait;
+  if(custWait > slot->maxWait) slot->maxWait = custWait;
+  slot->wait[metricsBucket(custWait)]++;
+  metricsEnd(&slot->seq);
+}
+
+// Teller finished with their customer
+static inline void metricsServed(MetricsTeller* slot) {
+  if(slot == NULL) return;
+  metricsBegin(&slot->seq);
+  slot->served++;
+  metricsEnd(&slot->seq);
+}
+
+// Mark the day over and unmap, the object is removed so it does not outlive
+// the run but monitors still mapping it keep the final figures
+void metricsClose(MetricsSegment* m, const char* name) {
+  int i;
+  if(m == NULL) return;
+  for(i = 0; i < m->tellers; i++) {
+    metricsBegin(&m->teller[i].seq);
+    m->teller[i].state = MS_DONE;
+    metricsEnd(&m->teller[i].seq);
+  }
+  __atomic_store_n(&m->done, 1, __ATOMIC_RELEASE);
+  munmap(m, sizeof(MetricsSegment));
+  shm_unlink(name);
+}
+
+// dequeue with mutex guarding access and line stat logic
+// id is the teller asking, which only matters with a line per teller
+Customer* getNextCust(Bank* b, int id) {
+  Customer* nextCust = NULL;
+  int closed;
+  if(b->cfg.discipline != DISC_SHARED) {
+    // Holding a semaphore count means a customer is waiting somewhere unless
+    // it is a closing wakeup, so only give up once the bank has closed
+    for(;;) {
+      nextCust = leaveLine(b, id);
+      if(nextCust != NULL) return nextCust;
+      pthread_mutex_lock(&b->lock);
+      closed = b->closed;
+      pthread_mutex_unlock(&b->lock);
+      if(closed) return leaveLine(b, id);
+      sched_yield(); // Lost a race for the customer we were counted, look again
+    }
+  }
+  if(b->customers.lockFree) return ringPop(&b->customers.ring);
+  pthread_mutex_lock(&b->customers.lock);
+  nextCust = dequeue(&b->customers.q);
+  pthread_mutex_unlock(&b->customers.lock);
+  return nextCust;
+}
+
+// enqueue with mutex guarding access and line stat logic
+// Returns depth customer joined at, newCust belongs to the tellers once added
+int addCustomer(Bank* b, Customer* newCust) {
+  int depth;
+  if(newCust == NULL) return 0;
+  if(b->cfg.discipline != DISC_SHARED) {
+    depth = joinLine(b, newCust);
+  } else if(b->customers.lockFree) {
+    while((depth = ringPush(&b->customers.ring, newCust)) == 0) sched_yield(); // Full, let tellers catch up
+  } else {
+    pthread_mutex_lock(&b->customers.lock);
+    depth = enqueue(newCust, &b->customers.q);
+    pthread_mutex_unlock(&b->customers.lock);
+  }
+  metricRecord(&b->depth, depth); // Generator is the only writer
+  sem_post(&b->customers.semaphore);
+  return depth;
+}
+
+// Teller thread function
+void* teller(void* arg) {
+  Teller* self = (Teller*)arg;
+  Bank* b = self->bank;
+  int startWait = 0;
+  int endWait = 0;
+  int custWait;
+  TellerStats* st = &b->tellerStats[self->id];
+  PoolCache cache;
+  TraceRing* trace = traceAttach(b->trace, 0);
+  MetricsTeller* live = metricsTeller(b->metrics, self->id);
+
+  Customer* cur = NULL;
+  poolCacheInit(&cache);
+  for(;;) {
+    startWait = clockNow(&b->clock);
+    traceEvent(trace, startWait, TR_TELLER_IDLE, self->id + 1, -1, 0);
+    metricsIdle(live);
+    sem_wait(&b->customers.semaphore);
+    endWait = clockNow(&b->clock);
+    cur = getNextCust(b, self->id);
+    if(cur == NULL) {
+      break;
+    }
+    custWait = clockNow(&b->clock) - cur->startWaitTime;
+    traceEvent(trace, cur->startWaitTime + custWait, TR_SERVICE_START, self->id + 1, cur->id, custWait);
+    metricsServe(live, cur->id, custWait);
+    metricRecord(&st->custWait, custWait);
+    metricRecord(&st->tellWait, endWait - startWait);
+    simWait(b, cur->transTime); // Sim transaction
+    metricRecord(&st->transTime, cur->transTime);
+    traceEvent(trace, clockNow(&b->clock), TR_SERVICE_END, self->id + 1, cur->id, cur->transTime);
+    metricsServed(live);
+    poolFree(&b->pool, &cache, cur);
+  }
+  traceDetach(trace);
+  poolCacheDone(&b->pool, &cache);
+  return NULL;
+}
+
+// Customer generation thread function
+void* customerGen(void* arg) {
+  Bank* b = (Bank*)arg;
+  int id = 1;
+  int stopGenerating = 0;
+  int arrived;
+  int depth;
+  int gap;
+  ArrivalSource source;
+  Customer* cust = NULL;
+  PoolCache cache;
+  TraceRing* trace = traceAttach(b->trace, 0);
+  poolCacheInit(&cache);
+  sourceInit(&source, &b->cfg, b->replication);
+  for(;;) {
+    pthread_mutex_lock(&b->lock);
+    stopGenerating = b->closed;
+    pthread_mutex_unlock(&b->lock);
+    if(stopGenerating || !sourceNext(&source, &gap)) break;
+    simWait(b, gap);
+    cust = poolAlloc(&b->pool, &cache);
+    cust->id = id;
+    cust->transTime = source.service; // Fixed by id, whichever teller gets them
+    arrived = clockNow(&b->clock);
+    cust->startWaitTime = arrived;
+    traceEvent(trace, arrived, TR_ARRIVAL, 0, id, cust->transTime);
+    depth = addCustomer(b, cust); // cust may already be served and freed after this
+    traceEvent(trace, arrived, TR_ENQUEUE, 0, id, depth);
+    if(b->metrics != NULL) {
+      metricsBegin(&b->metrics->gen.seq);
+      b->metrics->gen.arrivals = id;
+      b->metrics->gen.lastDepth = depth;
+      if(depth > b->metrics->gen.maxDepth) b->metrics->gen.maxDepth = depth;
+      metricsEnd(&b->metrics->gen.seq);
+    }
+    id++;
+  }
+  traceDetach(trace);
+  poolCacheDone(&b->pool, &cache);
+  return NULL;
+}
+
+// Arm the configured tick backend at periodNs
+void tickInit(TickSource* ticker, long periodNs) {
+  struct itimerspec timer;
+#ifdef __QNX__
+  struct _clockperiod clkper;
+  struct sigevent event;
+  int pulse_id = 0;
+
+  clkper.nsec = 100000;
+  clkper.fract = 0;
+  ClockPeriod ( CLOCK_REALTIME, &clkper, NULL, 0 );
+#endif
+
+  ticker->periodNs = periodNs;
+  ticker->ticks = 0;
+  ticker->overruns = 0;
+  ticker->missed = 0;
+  ticker->lateNs = 0;
+  ticker->maxLateNs = 0;
+  memset(&ticker->interval, 0, sizeof(Metric));
+  timer.it_value.tv_sec = 0;
+  timer.it_value.tv_nsec = periodNs;
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_nsec = periodNs;
+
+  switch(ticker->backend) {
+#ifdef __QNX__
+    case TICK_PULSE:
+      ticker->chid = ChannelCreate( 0 );
+      event.sigev_notify = SIGEV_PULSE;   // most basic message we can send -- just a pulse number
+      event.sigev_coid = ConnectAttach ( ND_LOCAL_NODE, 0, ticker->chid, 0, 0 );  // Get ID that allows me to communicate on the channel
+      assert ( event.sigev_coid != -1 );    // stop with error if cannot attach to channel
+      event.sigev_priority = getprio(0);
+      event.sigev_code = 1023;        // arbitrary number assigned to this pulse
+      event.sigev_value.sival_ptr = (void*)pulse_id;
+      if ( timer_create( CLOCK_REALTIME, &event, &ticker->timer ) == -1 )  // CLOCK_REALTIME available in all POSIX systems
+      {
+        perror ( "cannot create timer" );
+        exit( EXIT_FAILURE );
+      }
+      /* Start the timer. */
+      if ( timer_settime( ticker->timer, 0, &timer, NULL ) == -1 )
+      {
+        perror("Cannot start timer.\n");
+        exit( EXIT_FAILURE );
+      }
+      break;
+#endif
+#ifdef __linux__
+    case TICK_TIMERFD:
+      ticker->fd = timerfd_create(CLOCK_MONOTONIC, 0);
+      if(ticker->fd == -1 || timerfd_settime(ticker->fd, 0, &timer, NULL) == -1) {
+        perror("Cannot start timerfd");
+        exit( EXIT_FAILURE );
+      }
+      break;
+#endif
+    case TICK_NANOSLEEP:
+      clock_gettime(CLOCK_MONOTONIC, &ticker->next);
+      break;
+    default:
+      fprintf(stderr, "Tick backend not available on this OS\n");
+      exit( EXIT_FAILURE );
+  }
+  ticker->start = nowNanos();
+  ticker->last = ticker->start;
+}
+
+// Block until the next tick, returns number of periods elapsed since the last one
+int tickWait(TickSource* ticker) {
+  int periods = 1;
+  uint64_t now;
+  uint64_t ideal;
+#ifdef __QNX__
+  struct _pulse pulse;
+#endif
+#ifdef __linux__
+  uint64_t expirations;
+#endif
+
+  switch(ticker->backend) {
+#ifdef __QNX__
+    case TICK_PULSE:
+      MsgReceivePulse (ticker->chid, &pulse, sizeof( pulse ), NULL);
+      break;
+#endif
+#ifdef __linux__
+    case TICK_TIMERFD:
+      if(read(ticker->fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+        periods = (int)expirations; // Kernel counts expirations we slept through
+      }
+      break;
+#endif
+    default:
+      ticker->next.tv_nsec += ticker->periodNs;
+      while(ticker->next.tv_nsec >= 1000000000L) {
+        ticker->next.tv_nsec -= 1000000000L;
+        ticker->next.tv_sec++;
+      }
+      while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ticker->next, NULL) == EINTR);
+      break;
+  }
+
+  // Compare against the ideal schedule since arming
+  now = nowNanos();
+  metricRecord(&ticker->interval, (int)(now - ticker->last));
+  ticker->last = now;
+  ticker->ticks += periods;
+  ideal = ticker->start + ticker->ticks * ticker->periodNs;
+  ticker->lateNs = (int64_t)(now - ideal);
+  if(ticker->lateNs >= ticker->periodNs) {
+    // Whole periods passed while we were not listening
+    periods += ticker->lateNs / ticker->periodNs;
+    ticker->ticks += ticker->lateNs / ticker->periodNs;
+    if(ticker->backend == TICK_NANOSLEEP) {
+      ticker->next.tv_sec = (ticker->start + ticker->ticks * ticker->periodNs) / 1000000000ULL;
+      ticker->next.tv_nsec = (ticker->start + ticker->ticks * ticker->periodNs) % 1000000000ULL;
+    }
+    ticker->lateNs %= ticker->periodNs;
+  }
+  if(periods > 1) {
+    ticker->overruns += periods - 1;
+    ticker->missed++;
+  }
+  if(ticker->lateNs > ticker->maxLateNs) ticker->maxLateNs = ticker->lateNs;
+  return periods;
+}
+
+// Bank simulation thread function
+void* bankClock(void* arg) {
+  Bank* b = (Bank*)arg;
+  struct sched_param param;
+  int ret;
+
+  param.sched_priority = sched_get_priority_max( SCHED_RR );
+  ret = pthread_setschedparam( pthread_self(), SCHED_RR, &param);
+  if ( ret != 0 ) {
+    // Linux needs CAP_SYS_NICE, keep running but drift numbers will show it
+    fprintf(stderr, "cannot set SCHED_RR priority: %s\n", strerror(ret));
+  }
+
+  int periods;
+  uint64_t fanStart;
+
+  memset(&b->clock.fanout, 0, sizeof(Metric));
+  tickInit(&b->clock.ticker, b->clock.periodNs);
+  for(;;) {
+    if(b->clock.kill) break;
+    periods = tickWait(&b->clock.ticker);
+    if(!b->clock.catchUp) periods = 1; // Late ticks stretch simulated time instead
+    fanStart = nowNanos();
+    if(b->clock.useWheel) {
+      pthread_mutex_lock(&b->clock.lock);
+      for(; periods > 0; periods--) {
+        clockAdvance(&b->clock, 1);
+        expireTimers(&b->clock); // Only wake waiters whose deadline is now
+      }
+      pthread_mutex_unlock(&b->clock.lock);
+    } else {
+      clockAdvance(&b->clock, periods);
+      pthread_cond_broadcast(&b->clock.tick);
+    }
+    metricRecord(&b->clock.fanout, (int)(nowNanos() - fanStart));
+    if(b->metrics != NULL) {
+      metricsBegin(&b->metrics->clock.seq);
+      b->metrics->clock.secs = clockNow(&b->clock);
+      b->metrics->clock.closeTime = b->clock.closeTime;
+      b->metrics->clock.ticks = b->clock.ticker.ticks;
+      b->metrics->clock.missed = b->clock.ticker.missed;
+      metricsEnd(&b->metrics->clock.seq);
+    }
+    if(clockNow(&b->clock) > b->clock.closeTime) pthread_cond_signal(&b->open);
+  }
+  return NULL;
+}
+
+// Bank simulation thread function
+void* runBank(void* arg) {
+  Bank* b = (Bank*)arg;
+  int i;
+  pthread_cond_init(&b->open, NULL);
+  pthread_mutex_init(&b->wait, NULL);
+
+  if(!b->quiet) printf("Bank opening\n");
+  pthread_mutex_lock(&b->wait);
+  pthread_cond_wait(&b->open, &b->wait);
+  pthread_mutex_unlock(&b->wait);
+  pthread_mutex_lock(&b->lock);
+  b->closed = 1;
+  pthread_mutex_unlock(&b->lock);
+  if(!b->quiet) printf("Bank Closing\n");
+  // Anyone already on their way in still gets served, as in the event engine
+  pthread_join(b->customers.thread, NULL);
+  for(i = 0; i < b->cfg.tellers; i++) {
+    sem_post(&b->customers.semaphore);
+  }
+  return NULL;
+}
+
+void openBank(Bank* b) {
+  // Init bank vars
+  bankSetup(b);
+  b->clock.kill = 0;
+  b->closed = 0;
+  b->clock.secs = 0;
+  b->clock.closeTime = b->cfg.openHours * 60 * 60;
+  b->clock.periodNs = b->cfg.tickNs;
+  b->clock.ticker.backend = b->cfg.tickBackend;
+  b->clock.useWheel = b->cfg.useWheel;
+  b->clock.catchUp = b->cfg.catchUp;
+  b->customers.lockFree = b->cfg.lockFree;
+  memset(b->clock.wheel, 0, sizeof(b->clock.wheel));
+  pthread_cond_init(&b->clock.tick, NULL);
+  pthread_mutex_init(&b->customers.lock, NULL);
+  ringInit(&b->customers.ring);
+  poolInit(&b->pool);
+  resetStats(b);
+  pthread_mutex_init(&b->lock, NULL);
+  pthread_mutex_init(&b->clock.lock, NULL);
+  sem_init(&b->customers.semaphore, 0, 0);
+
+  // Set lower priority for threads
+  pthread_attr_t threadAttributes ;
+  int policy;
+  struct sched_param parameters ;
+  pthread_attr_init(&threadAttributes) ;    // initialize thread attributes structure -- must do before any other activity on this struct
+  pthread_getschedparam(pthread_self(), &policy, &parameters) ; // get this main thread's scheduler parameters
+  parameters.sched_priority--;                  // lower the priority
+  pthread_attr_setschedparam(&threadAttributes, &parameters) ;  // set up the pthread_attr struct with the updated priority
+
+  pthread_create(&b->clock.thread, NULL, &bankClock, b); // Start sim clock
+  pthread_create(&b->thread, &threadAttributes, &runBank, b); // Start bank
+  int i;
+  for(i = 0; i < b->cfg.tellers; i++) {
+    b->tellers[i].bank = b;
+    b->tellers[i].id = i;
+    pthread_create(&b->tellers[i].thread, &threadAttributes, &teller, &b->tellers[i]); // Start tellers
+  }
+  pthread_create(&b->customers.thread, &threadAttributes, &customerGen, b); // Start customer generation
+}
+
+// Wait till teller threads have finished and kill clock thread
+void closeBank(Bank* b) {
+  int i;
+  for(i = 0; i < b->cfg.tellers; i++) {
+    pthread_join(b->tellers[i].thread, NULL);
+  }
+  pthread_join(b->thread, NULL);
+  b->clock.kill = 1;
+  pthread_join(b->clock.thread, NULL); // Tick stats are final once it exits
+}
+
+// Index of each figure stats() reports for a day
+typedef enum SummaryField{
+  S_SERVED = 0,
+  S_MAX_DEPTH,
+  S_MAX_TRANS,
+  S_AVG_TRANS,
+  S_MAX_TELL_WAIT,
+  S_AVG_TELL_WAIT,
+  S_MAX_CUST_WAIT,
+  S_AVG_CUST_WAIT,
+  S_P50_TRANS,
+  S_P90_TRANS,
+  S_P99_TRANS,
+  S_P50_TELL_WAIT,
+  S_P90_TELL_WAIT,
+  S_P99_TELL_WAIT,
+  S_P50_CUST_WAIT,
+  S_P90_CUST_WAIT,
+  S_P95_CUST_WAIT, // Staffing SLA figure
+  S_P99_CUST_WAIT,
+  S_DAY_SECS, // Simulated seconds until the last customer left
+  S_COUNT
+}SummaryField;
+
+// Labels matching SummaryField
+const char* summaryNames[S_COUNT] = {
+  "customers served", "max queue depth",
+  "max transaction time", "avg transaction time",
+  "max teller wait", "avg teller wait",
+  "max customer wait", "avg customer wait",
+  "p50 transaction time", "p90 transaction time", "p99 transaction time",
+  "p50 teller wait", "p90 teller wait", "p99 teller wait",
+  "p50 customer wait", "p90 customer wait", "p95 customer wait", "p99 customer wait",
+  "day length"
+};
+
+// Figures for one simulated day
+typedef struct Summary{
+  double v[S_COUNT];
+}Summary;
+
+// Merge a finished day's accumulators into its summary figures
+void summarize(Bank* b, Summary* sum) {
+  TellerStats total;
+  int i;
+  memset(&total, 0, sizeof(TellerStats));
+  // Tellers have been joined, so their accumulators can be read without locks
+  for(i = 0; i < b->cfg.tellers; i++) {
+    metricMerge(&total.custWait, &b->tellerStats[i].custWait);
+    metricMerge(&total.transTime, &b->tellerStats[i].transTime);
+    metricMerge(&total.tellWait, &b->tellerStats[i].tellWait);
+  }
+  sum->v[S_SERVED] = total.transTime.count;
+  sum->v[S_MAX_DEPTH] = b->depth.max;
+  sum->v[S_MAX_TRANS] = total.transTime.max;
+  sum->v[S_AVG_TRANS] = metricAvg(&total.transTime);
+  sum->v[S_MAX_TELL_WAIT] = total.tellWait.max;
+  sum->v[S_AVG_TELL_WAIT] = metricAvg(&total.tellWait);
+  sum->v[S_MAX_CUST_WAIT] = total.custWait.max;
+  sum->v[S_AVG_CUST_WAIT] = metricAvg(&total.custWait);
+  sum->v[S_P50_TRANS] = metricPercentile(&total.transTime, 50);
+  sum->v[S_P90_TRANS] = metricPercentile(&total.transTime, 90);
+  sum->v[S_P99_TRANS] = metricPercentile(&total.transTime, 99);
+  sum->v[S_P50_TELL_WAIT] = metricPercentile(&total.tellWait, 50);
+  sum->v[S_P90_TELL_WAIT] = metricPercentile(&total.tellWait, 90);
+  sum->v[S_P99_TELL_WAIT] = metricPercentile(&total.tellWait, 99);
+  sum->v[S_P50_CUST_WAIT] = metricPercentile(&total.custWait, 50);
+  sum->v[S_P90_CUST_WAIT] = metricPercentile(&total.custWait, 90);
+  sum->v[S_P95_CUST_WAIT] = metricPercentile(&total.custWait, 95);
+  sum->v[S_P99_CUST_WAIT] = metricPercentile(&total.custWait, 99);
+  sum->v[S_DAY_SECS] = b->clock.secs;
+}
+
+void stats(Bank* b) {
+  Summary sum;
+  summarize(b, &sum);
+  if(sum.v[S_SERVED] == 0) {
+    printf("No customers served today\n");
+    return;
+  }
+  printf("Total customers served today: %d\n", (int)sum.v[S_SERVED]);
+  printf("The maximum queue depth was %d\n", (int)sum.v[S_MAX_DEPTH]);
+  printf("The maximum teller transaction time was %d\n", (int)sum.v[S_MAX_TRANS]);
+  printf("The average transaction time was: %d\n", (int)sum.v[S_AVG_TRANS]);
+  printf("The maximum teller wait time was %d\n", (int)sum.v[S_MAX_TELL_WAIT]);
+  printf("The average teller wait time was %d\n", (int)sum.v[S_AVG_TELL_WAIT]);
+  printf("The maximum customer wait time was %d\n", (int)sum.v[S_MAX_CUST_WAIT]);
+  printf("The average customer wait time was %d\n", (int)sum.v[S_AVG_CUST_WAIT]);
+  printf("Transaction time p50/p90/p99: %d/%d/%d\n", (int)sum.v[S_P50_TRANS],
+    (int)sum.v[S_P90_TRANS], (int)sum.v[S_P99_TRANS]);
+  printf("Teller wait time p50/p90/p99: %d/%d/%d\n", (int)sum.v[S_P50_TELL_WAIT],
+    (int)sum.v[S_P90_TELL_WAIT], (int)sum.v[S_P99_TELL_WAIT]);
+  printf("Customer wait time p50/p90/p99: %d/%d/%d\n", (int)sum.v[S_P50_CUST_WAIT],
+    (int)sum.v[S_P90_CUST_WAIT], (int)sum.v[S_P99_CUST_WAIT]);
+}
+
+// Discrete event types, in order of precedence for events on the same second
+typedef enum EventType{
+  EV_SERVICE_END = 0, // Teller finished with customer
+  EV_ARRIVAL, // Customer walks in and joins the queue
+  EV_SERVICE_START, // Teller takes customer from the queue
+  EV_CLOSE, // Bank stops letting customers in
+  EV_TRANSFER // Customer redirected from another branch walks in
+}EventType;
+
+// Timestamped simulation event
+typedef struct Event{
+  int time; // Simulated second the event fires
+  int seq; // Scheduling order, breaks ties between equal events
+  EventType type;
+  int teller; // Teller index for service events
+  Customer* cust; // Customer the event applies to
+}Event;
+
+// Binary min-heap of pending events ordered by (time, type, seq)
+typedef struct EventQueue{
+  Event* heap;
+  int size;
+  int cap;
+  int seq;
+}EventQueue;
+
+// Teller state for the event engine
+typedef struct EventTeller{
+  int busy; // Boolean whether teller has a customer
+  int idleSince; // Simulated second the teller last became free
+}EventTeller;
+
+// Ordering used by the event heap
+int eventBefore(Event* a, Event* b) {
+  if(a->time != b->time) return a->time < b->time;
+  if(a->type != b->type) return a->type < b->type;
+  return a->seq < b->seq;
+}
+
+// Add event to heap
+void schedule(EventQueue* events, int time, EventType type, int teller, Customer* cust) {
+  Event ev;
+  Event tmp;
+  int i;
+  int parent;
+  if(events->size == events->cap) {
+    events->cap = events->cap ? events->cap * 2 : 64;
+    events->heap = (Event*)realloc(events->heap, events->cap * sizeof(Event));
+    assert(events->heap != NULL);
+  }
+  ev.time = time;
+  ev.seq = events->seq++;
+  ev.type = type;
+  ev.teller = teller;
+  ev.cust = cust;
+  i = events->size++;
+  events->heap[i] = ev;
+  while(i > 0) {
+    parent = (i - 1) / 2;
+    if(!eventBefore(&events->heap[i], &events->heap[parent])) break;
+    tmp = events->heap[parent];
+    events->heap[parent] = events->heap[i];
+    events->heap[i] = tmp;
+    i = parent;
+  }
+}
+
+// Remove earliest event from heap, returns 0 when empty
+int nextEvent(EventQueue* events, Event* out) {
+  Event tmp;
+  int i = 0;
+  int child;
+  if(events->size == 0) return 0;
+  *out = events->heap[0];
+  events->heap[0] = events->heap[--events->size];
+  for(;;) {
+    child = 2 * i + 1;
+    if(child >= events->size) break;
+    if(child + 1 < events->size && eventBefore(&events->heap[child + 1], &events->heap[child])) child++;
+    if(!eventBefore(&events->heap[child], &events->heap[i])) break;
+    tmp = events->heap[child];
+    events->heap[child] = events->heap[i];
+    events->heap[i] = tmp;
+    i = child;
+  }
+  return 1;
+}
+
+// Hand queued customers to idle tellers
+// The shared line goes to whoever has been idle longest, like threaded tellers
+// queued up on the semaphore. With a line per teller, idle tellers first serve
+// their own lines, then steal
+void dispatchTellers(Bank* b, EventQueue* events, EventTeller* tellers, int now) {
+  Customer* cust;
+  int pass;
+  int next;
+  int i;
+  if(b->cfg.discipline == DISC_SHARED) {
+    while(b->customers.q.depth > 0) {
+      next = -1;
+      for(i = 0; i < b->cfg.tellers; i++) {
+        if(tellers[i].busy) continue;
+        if(next < 0 || tellers[i].idleSince < tellers[next].idleSince) next = i;
+      }
+      if(next < 0) break;
+      tellers[next].busy = 1;
+      schedule(events, now, EV_SERVICE_START, next, dequeue(&b->customers.q));
+    }
+    return;
+  }
+  for(pass = 0; pass < 2; pass++) {
+    for(i = 0; i < b->cfg.tellers; i++) {
+      if(tellers[i].busy) continue;
+      cust = pass == 0 ? dequePop(&b->tellers[i].line, 0) : leaveLine(b, i);
+      if(cust == NULL) continue;
+      tellers[i].busy = 1;
+      schedule(events, now, EV_SERVICE_START, i, cust);
+    }
+  }
+}
+
+// Customer redirected between branches, in flight
+typedef struct Transfer{
+  int time; // Second they walk into the destination branch
+  int branch; // Destination branch
+  int from; // Origin branch
+  int seq; // Redirect attempts before this one at the origin, orders the merge
+  int id; // Customer id at the origin
+  int startWaitTime; // Kept, so their wait includes the trip
+  int transTime;
+}Transfer;
+
+// Transfers one branch sent during the current window
+// Only the sending shard writes it while the window runs and only the
+// receiving shard reads it between the window's barriers, so the barriers
+// are all the synchronisation it needs. Capacity is per branch, which keeps
+// refusals the same however branches are packed onto shards
+typedef struct Mailbox{
+  Transfer* slots; // Grown on demand up to MAILBOX_SIZE
+  int count;
+  int cap;
+}Mailbox;
+
+// Add transfer to mailbox, returns 0 if the branch has sent MAILBOX_SIZE this window
+int mailboxPush(Mailbox* box, Transfer* transfer) {
+  if(box->count == MAILBOX_SIZE) return 0;
+  if(box->count == box->cap) {
+    box->cap = box->cap ? box->cap * 2 : 64;
+    box->slots = (Transfer*)realloc(box->slots, box->cap * sizeof(Transfer));
+    assert(box->slots != NULL);
+  }
+  box->slots[box->count++] = *transfer;
+  return 1;
+}
+
+// Event engine state for one bank day, kept outside the loop so a day can be
+// run in time slices (multi-branch shards) as well as in one go
+typedef struct EventDay{
+  EventQueue events;
+  EventTeller* tellers;
+  ArrivalSource source;
+  PoolCache cache;
+  TraceRing* trace;
+  int id; // Next customer id
+  Mailbox* outbox; // Where redirected customers go, NULL for a lone bank
+  int branch; // Index of this bank in its network
+  int redirectTo; // Branch redirected customers go to
+  int sent; // Customers redirected away
+  int received; // Customers redirected here
+  int refused; // Redirects dropped because this window's mailbox was full
+}EventDay;
+
+// Open the bank for an event engine day
+void eventDayStart(Bank* b, EventDay* day) {
+  int gap;
+  int i;
+  memset(day, 0, sizeof(EventDay));
+  day->trace = traceAttach(b->trace, 1);
+  day->id = 1;
+  bankSetup(b);
+  day->tellers = (EventTeller*)malloc(b->cfg.tellers * sizeof(EventTeller));
+  assert(day->tellers != NULL);
+  b->closed = 0;
+  b->clock.secs = 0;
+  memset(&b->customers.q, 0, sizeof(Queue));
+  resetStats(b);
+  poolInit(&b->pool);
+  poolCacheInit(&day->cache);
+  for(i = 0; i < b->cfg.tellers; i++) {
+    day->tellers[i].busy = 0;
+    day->tellers[i].idleSince = 0;
+    traceEvent(day->trace, 0, TR_TELLER_IDLE, i + 1, -1, 0);
+  }
+  sourceInit(&day->source, &b->cfg, b->replication);
+
+  if(!b->quiet) printf("Bank opening\n");
+  schedule(&day->events, b->cfg.openHours * 60 * 60 + 1, EV_CLOSE, -1, NULL);
+  if(sourceNext(&day->source, &gap)) schedule(&day->events, gap, EV_ARRIVAL, -1, NULL);
+}
+
+// Customers waiting in line, shared or per teller
+int lineDepth(Bank* b) {
+  int depth = 0;
+  int i;
+  if(b->cfg.discipline == DISC_SHARED) return b->customers.q.depth;
+  for(i = 0; i < b->cfg.tellers; i++) depth += b->tellers[i].line.depth;
+  return depth;
+}
+
+// Put customer in line, record what they saw and hand out idle tellers
+void eventJoin(Bank* b, EventDay* day, Customer* cust, int now) {
+  int depth;
+  if(b->cfg.discipline != DISC_SHARED) depth = joinLine(b, cust);
+  else depth = enqueue(cust, &b->customers.q);
+  metricRecord(&b->depth, depth);
+  traceEvent(day->trace, now, TR_ENQUEUE, 0, cust->id, depth);
+  dispatchTellers(b, &day->events, day->tellers, now);
+}
+
+// Process every pending event before until, returns 0 once the day has none left
+int eventDayRun(Bank* b, EventDay* day, int until) {
+  Event ev;
+  Customer* cust = NULL;
+  Transfer transfer;
+  int gap;
+  while(day->events.size > 0 && day->events.heap[0].time < until) {
+    nextEvent(&day->events, &ev);
+    b->clock.secs = ev.time;
+    switch(ev.type) {
+      case EV_ARRIVAL:
+        cust = poolAlloc(&b->pool, &day->cache);
+        cust->id = day->id++;
+        cust->next = NULL;
+        cust->startWaitTime = ev.time;
+        cust->transTime = day->source.service;
+        traceEvent(day->trace, ev.time, TR_ARRIVAL, 0, cust->id, cust->transTime);
+        // Like customerGen, only stop once the bank has closed
+        if(!b->closed && sourceNext(&day->source, &gap)) {
+          schedule(&day->events, ev.time + gap, EV_ARRIVAL, -1, NULL);
+        }
+        if(day->outbox != NULL && lineDepth(b) >= b->cfg.transferDepth) {
+          // Line too long, send them to the next branch
+          transfer.time = ev.time + b->cfg.transferSecs;
+          transfer.branch = day->redirectTo;
+          transfer.from = day->branch;
+          transfer.seq = day->sent + day->refused;
+          transfer.id = cust->id;
+          transfer.startWaitTime = cust->startWaitTime;
+          transfer.transTime = cust->transTime;
+          if(mailboxPush(day->outbox, &transfer)) {
+            day->sent++;
+            poolFree(&b->pool, &day->cache, cust);
+            break;
+          }
+          day->refused++; // Mailbox full, they stay
+        }
+        eventJoin(b, day, cust, ev.time);
+        break;
+      case EV_TRANSFER:
+        day->received++;
+        eventJoin(b, day, ev.cust, ev.time); // Never redirected twice
+        break;
+      case EV_SERVICE_START:
+        cust = ev.cust;
+        traceEvent(day->trace, ev.time, TR_SERVICE_START, ev.teller + 1, cust->id, ev.time - cust->startWaitTime);
+        metricRecord(&b->tellerStats[ev.teller].custWait, ev.time - cust->startWaitTime);
+        metricRecord(&b->tellerStats[ev.teller].tellWait, ev.time - day->tellers[ev.teller].idleSince);
+        metricRecord(&b->tellerStats[ev.teller].transTime, cust->transTime);
+        schedule(&day->events, ev.time + cust->transTime, EV_SERVICE_END, ev.teller, cust);
+        break;
+      case EV_SERVICE_END:
+        traceEvent(day->trace, ev.time, TR_SERVICE_END, ev.teller + 1, ev.cust->id, ev.cust->transTime);
+        poolFree(&b->pool, &day->cache, ev.cust);
+        day->tellers[ev.teller].busy = 0;
+        day->tellers[ev.teller].idleSince = ev.time;
+        traceEvent(day->trace, ev.time, TR_TELLER_IDLE, ev.teller + 1, -1, 0);
+        dispatchTellers(b, &day->events, day->tellers, ev.time);
+        break;
+      case EV_CLOSE:
+        b->closed = 1;
+        if(!b->quiet) printf("Bank Closing\n");
+        break;
+    }
+  }
+  return day->events.size > 0;
+}
+
+// Release an event engine day's working state, stats stay in the bank
+void eventDayEnd(Bank* b, EventDay* day) {
+  traceDetach(day->trace);
+  poolCacheDone(&b->pool, &day->cache);
+  free(day->tellers);
+  free(day->events.heap);
+}
+
+#define SNAPSHOT_MAGIC "BNKSNAP1" // First 8 bytes of a snapshot file
+
+// Snapshot file header, native byte order and struct layout, so a snapshot
+// only loads into the build that wrote it
+// Followed by cfg.tellers TellerStats, cfg.tellers EventTellers, events
+// SnapEvents in heap order and waiting SnapCustomers in line order
+typedef struct SnapshotHeader{
+  char magic[8]; // SNAPSHOT_MAGIC
+  uint32_t headerSize; // sizeof(SnapshotHeader), catches a different build
+  uint32_t tellerStatsSize; // sizeof(TellerStats)
+  Config cfg; // Day parameters, arrivalLog is only recorded as present or not
+  int hadLog; // Boolean whether arrivals were replayed from a log
+  unsigned int replication;
+  int secs; // Simulated second of the last event run
+  int closed; // Boolean whether the doors had shut
+  int nextLine; // Customers.nextLine (DISC_RR)
+  int id; // Next customer id
+  int events; // Pending events
+  int eventSeq; // EventQueue.seq
+  int waiting; // Customers in line
+  ArrivalSource source; // Random stream positions and log cursor
+  Metric depth;
+}SnapshotHeader;
+
+// Customer in a snapshot, by value
+typedef struct SnapCustomer{
+  int line; // Teller line they wait in, -1 for the shared line or none
+  int id;
+  int startWaitTime;
+  int transTime;
+}SnapCustomer;
+
+// Pending event in a snapshot
+typedef struct SnapEvent{
+  int time;
+  int seq;
+  int type; // EventType
+  int teller;
+  int hasCust; // Boolean whether cust is set
+  SnapCustomer cust;
+}SnapEvent;
+
+// Append bytes to buffer
+void snapPut(SnapBuf* buf, const void* bytes, size_t n) {
+  if(buf->len + n > buf->cap) {
+    while(buf->len + n > buf->cap) buf->cap = buf->cap ? buf->cap * 2 : 65536;
+    buf->data = (char*)realloc(buf->data, buf->cap);
+    assert(buf->data != NULL);
+  }
+  memcpy(buf->data + buf->len, bytes, n);
+  buf->len += n;
+}
+
+// Copy the next n bytes of a snapshot out, returns 0 if it is too short
+int snapTake(const char** pos, const char* end, void* bytes, size_t n) {
+  if((size_t)(end - *pos) < n) return 0;
+  memcpy(bytes, *pos, n);
+  *pos += n;
+  return 1;
+}
+
+// Snapshot form of a customer
+void snapCustomer(SnapCustomer* out, Customer* cust, int line) {
+  out->line = line;
+  out->id = cust->id;
+  out->startWaitTime = cust->startWaitTime;
+  out->transTime = cust->transTime;
+}
+
+// Serialize a lone bank's event engine day between events into buf
+void snapshotSave(Bank* b, EventDay* day, SnapBuf* buf) {
+  SnapshotHeader h;
+  SnapEvent ev;
+  SnapCustomer sc;
+  Customer* cust;
+  Deque* line;
+  int i;
+  int j;
+
+  memset(&h, 0, sizeof(SnapshotHeader));
+  memcpy(h.magic, SNAPSHOT_MAGIC, 8);
+  h.headerSize = sizeof(SnapshotHeader);
+  h.tellerStatsSize = sizeof(TellerStats);
+  h.cfg = b->cfg;
+  h.cfg.arrivalLog = NULL;
+  h.hadLog = b->cfg.arrivalLog != NULL;
+  h.replication = b->replication;
+  h.secs = b->clock.secs;
+  h.closed = b->closed;
+  h.nextLine = b->customers.nextLine;
+  h.id = day->id;
+  h.events = day->events.size;
+  h.eventSeq = day->events.seq;
+  h.waiting = lineDepth(b);
+  h.source = day->source;
+  h.source.log = NULL;
+  h.depth = b->depth;
+  snapPut(buf, &h, sizeof(SnapshotHeader));
+  snapPut(buf, b->tellerStats, b->cfg.tellers * sizeof(TellerStats));
+  snapPut(buf, day->tellers, b->cfg.tellers * sizeof(EventTeller));
+  for(i = 0; i < day->events.size; i++) {
+    memset(&ev, 0, sizeof(SnapEvent));
+    ev.time = day->events.heap[i].time;
+    ev.seq = day->events.heap[i].seq;
+    ev.type = day->events.heap[i].type;
+    ev.teller = day->events.heap[i].teller;
+    ev.hasCust = day->events.heap[i].cust != NULL;
+    if(ev.hasCust) snapCustomer(&ev.cust, day->events.heap[i].cust, -1);
+    snapPut(buf, &ev, sizeof(SnapEvent));
+  }
+  if(b->cfg.discipline == DISC_SHARED) {
+    for(cust = b->customers.q.head; cust != NULL; cust = cust->next) {
+      snapCustomer(&sc, cust, -1);
+      snapPut(buf, &sc, sizeof(SnapCustomer));
+    }
+    return;
+  }
+  for(i = 0; i < b->cfg.tellers; i++) {
+    line = &b->tellers[i].line;
+    for(j = 0; j < line->depth; j++) {
+      snapCustomer(&sc, line->custs[(line->head + j) & (line->cap - 1)], i);
+      snapPut(buf, &sc, sizeof(SnapCustomer));
+    }
+  }
+}
+
+// Customer from a snapshot, allocated from the day's pool
+Customer* snapRestoreCustomer(Bank* b, EventDay* day, SnapCustomer* sc) {
+  Customer* cust = poolAlloc(&b->pool, &day->cache);
+  cust->next = NULL;
+  cust->id = sc->id;
+  cust->startWaitTime = sc->startWaitTime;
+  cust->transTime = sc->transTime;
+  return cust;
+}
+
+// Read the snapshot at path, mapped read only, NULL on failure
+const char* snapshotMap(const char* path, size_t* len) {
+  struct stat st;
+  void* data;
+  int fd = open(path, O_RDONLY);
+  if(fd < 0 || fstat(fd, &st) != 0) {
+    perror(path);
+    if(fd >= 0) close(fd);
+    return NULL;
+  }
+  if((size_t)st.st_size < sizeof(SnapshotHeader)) {
+    fprintf(stderr, "%s: too short for a snapshot\n", path);
+    close(fd);
+    return NULL;
+  }
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // Mapping stays valid
+  if(data == MAP_FAILED) {
+    perror(path);
+    return NULL;
+  }
+  if(memcmp(data, SNAPSHOT_MAGIC, 8) != 0 || ((SnapshotHeader*)data)->headerSize != sizeof(SnapshotHeader)
+      || ((SnapshotHeader*)data)->tellerStatsSize != sizeof(TellerStats)) {
+    fprintf(stderr, "%s: not a snapshot from this build\n", path);
+    munmap(data, st.st_size);
+    return NULL;
+  }
+  *len = st.st_size;
+  return (const char*)data;
+}
+
+// Take the day parameters of the snapshot at path as cfg, so options after
+// it on the command line make a what-if variant, returns 0 on failure
+int snapshotConfig(Config* cfg, const char* path) {
+  ArrivalLog* log = cfg->arrivalLog;
+  size_t len;
+  const char* data = snapshotMap(path, &len);
+  if(data == NULL) return 0;
+  *cfg = ((const SnapshotHeader*)data)->cfg;
+  cfg->arrivalLog = log; // Same log has to be given again with -a
+  munmap((void*)data, len);
+  return 1;
+}
+
+// Restore an event engine day from the snapshot at path in place of
+// eventDayStart, returns 0 on failure
+// b->cfg may differ from the snapshot's as a what-if: more tellers, who start
+// idle, or new arrival/service distributions for every draw not yet buffered.
+// Anything else would not describe the same day so far.
+int snapshotLoad(Bank* b, EventDay* day, const char* path) {
+  SnapshotHeader h;
+  SnapEvent ev;
+  SnapCustomer sc;
+  Customer* cust;
+  size_t len;
+  const char* data = snapshotMap(path, &len);
+  const char* pos = data;
+  const char* end = data + len;
+  int ok = 0;
+  int i;
+
+  if(data == NULL) return 0;
+  snapTake(&pos, end, &h, sizeof(SnapshotHeader));
+  if(b->cfg.tellers < h.cfg.tellers || b->cfg.openHours != h.cfg.openHours
+      || b->cfg.discipline != h.cfg.discipline || b->cfg.seed != h.cfg.seed
+      || (b->cfg.arrivalLog != NULL) != h.hadLog) {
+    fprintf(stderr, "%s: only more tellers or new distributions can change on resume\n", path);
+    munmap((void*)data, len);
+    return 0;
+  }
+
+  memset(day, 0, sizeof(EventDay));
+  day->trace = traceAttach(b->trace, 1);
+  day->id = h.id;
+  bankSetup(b);
+  day->tellers = (EventTeller*)malloc(b->cfg.tellers * sizeof(EventTeller));
+  assert(day->tellers != NULL);
+  b->replication = h.replication;
+  b->closed = h.closed;
+  b->clock.secs = h.secs;
+  b->customers.nextLine = h.nextLine % b->cfg.tellers;
+  memset(&b->customers.q, 0, sizeof(Queue));
+  resetStats(b);
+  b->depth = h.depth;
+  poolInit(&b->pool);
+  poolCacheInit(&day->cache);
+  for(i = h.cfg.tellers; i < b->cfg.tellers; i++) {
+    day->tellers[i].busy = 0; // What-if tellers clock in at the snapshot
+    day->tellers[i].idleSince = h.secs;
+  }
+  day->source = h.source;
+  day->source.log = b->cfg.arrivalLog;
+  if(memcmp(&day->source.arrivals.dist, &b->cfg.arrive, sizeof(Dist)) != 0) {
+    day->source.arrivals.dist = b->cfg.arrive;
+    day->source.arrivals.pos = RNG_BATCH; // Drop gaps drawn from the old distribution
+  }
+  if(memcmp(&day->source.services.dist, &b->cfg.service, sizeof(Dist)) != 0) {
+    day->source.services.dist = b->cfg.service;
+    day->source.services.pos = RNG_BATCH;
+  }
+
+  if(!snapTake(&pos, end, b->tellerStats, h.cfg.tellers * sizeof(TellerStats))
+      || !snapTake(&pos, end, day->tellers, h.cfg.tellers * sizeof(EventTeller))) goto done;
+  day->events.cap = h.events > 64 ? h.events : 64;
+  day->events.heap = (Event*)malloc(day->events.cap * sizeof(Event));
+  assert(day->events.heap != NULL);
+  for(i = 0; i < h.events; i++) {
+    if(!snapTake(&pos, end, &ev, sizeof(SnapEvent))) goto done;
+    day->events.heap[i].time = ev.time; // Same heap order, so same pops
+    day->events.heap[i].seq = ev.seq;
+    day->events.heap[i].type = (EventType)ev.type;
+    day->events.heap[i].teller = ev.teller;
+    day->events.heap[i].cust = ev.hasCust ? snapRestoreCustomer(b, day, &ev.cust) : NULL;
+    day->events.size++;
+  }
+  day->events.seq = h.eventSeq;
+  for(i = 0; i < h.waiting; i++) {
+    if(!snapTake(&pos, end, &sc, sizeof(SnapCustomer))) goto done;
+    cust = snapRestoreCustomer(b, day, &sc);
+    if(sc.line < 0) enqueue(cust, &b->customers.q);
+    else dequePush(&b->tellers[sc.line].line, cust);
+  }
+  if(b->cfg.tellers > h.cfg.tellers) dispatchTellers(b, &day->events, day->tellers, h.secs);
+  if(!b->quiet) printf("Resumed at %d secs from %s\n", h.secs, path);
+  ok = 1;
+done:
+  if(!ok) {
+    fprintf(stderr, "%s: truncated snapshot\n", path);
+    eventDayEnd(b, day);
+    poolRelease(&b->pool);
+  }
+  munmap((void*)data, len);
+  return ok;
+}
+
+// Write a finished snapshot buffer to path, replacing it only once complete
+void* checkpointWriter(void* arg) {
+  Checkpoint* ck = (Checkpoint*)arg;
+  char tmp[PATH_MAX];
+  size_t done = 0;
+  ssize_t n;
+  int fd;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", ck->path);
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0) {
+    perror(tmp);
+    return NULL;
+  }
+  while(done < ck->buf.len) {
+    n = write(fd, ck->buf.data + done, ck->buf.len - done);
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) break;
+    done += n;
+  }
+  if(done < ck->buf.len || fsync(fd) != 0) {
+    perror(tmp);
+    close(fd);
+    unlink(tmp);
+    return NULL;
+  }
+  close(fd);
+  if(rename(tmp, ck->path) != 0) {
+    perror(ck->path);
+    return NULL;
+  }
+  ck->written++;
+  return NULL;
+}
+
+// Snapshot the day and hand it to a writer thread, so the simulation only
+// stops for the copy; waits first if the previous snapshot is still writing
+void checkpointTake(Checkpoint* ck, Bank* b, EventDay* day) {
+  if(ck->writing) pthread_join(ck->thread, NULL);
+  ck->buf.len = 0;
+  snapshotSave(b, day, &ck->buf);
+  ck->writing = 1;
+  pthread_create(&ck->thread, NULL, &checkpointWriter, ck);
+}
+
+// Run an opened (or resumed) event engine day to the end, snapshotting every
+// b->checkpoint->every simulated seconds when checkpointing
+// Running in slices pops events in the same order as running straight through
+void runEventDay(Bank* b, EventDay* day) {
+  Checkpoint* ck = b->checkpoint;
+  int until;
+  if(ck == NULL) {
+    eventDayRun(b, day, INT_MAX);
+  } else {
+    until = (b->clock.secs / ck->every + 1) * ck->every;
+    while(eventDayRun(b, day, until)) {
+      checkpointTake(ck, b, day);
+      until += ck->every;
+    }
+    if(ck->writing) pthread_join(ck->thread, NULL);
+    ck->writing = 0;
+  }
+  eventDayEnd(b, day);
+}
+
+// Discrete event version of the bank day
+// Jumps straight from one event to the next instead of waiting on clock ticks,
+// uses the same random streams and accumulators as the threaded tellers
+void runEvents(Bank* b) {
+  EventDay day;
+  eventDayStart(b, &day);
+  runEventDay(b, &day);
+}
+
+// Stackless coroutines, protothread style
+// A coroutine is a function over its frame struct that returns 1 once it has
+// finished. CO_YIELD records where to carry on and returns to the caller, the
+// next call jumps straight back there through the switch. Locals do not
+// survive a yield, anything needed afterwards lives in the frame.
+#define CO_BEGIN(co) switch((co)->resume) { case 0:
+#define CO_YIELD(co) do { (co)->resume = __LINE__; return 0; case __LINE__:; } while(0)
+#define CO_END(co) } (co)->resume = -1; return 1
+
+// Customer coroutine frame, queued through its Customer
+typedef struct CoCustomer{
+  Customer cust; // First so a queued Customer* is also the frame
+  int resume; // Coroutine resume point
+  struct CoCustomer* nextFree; // Free list link once finished
+}CoCustomer;
+
+// Teller coroutine frame
+typedef struct CoTeller{
+  int resume;
+  int id; // Index into Bank.tellerStats
+  int idleSince; // Simulated second teller last became free
+  CoCustomer* cust; // Customer being served, bound by whoever woke the teller
+}CoTeller;
+
+// Customer generator coroutine frame
+typedef struct CoGen{
+  int resume;
+  int id; // Next customer id
+  ArrivalSource source;
+}CoGen;
+
+// Single threaded scheduler for the coroutine engine
+// Only sleeping coroutines sit in the event heap and customer frames exist
+// only between arrival and departure, so memory follows the live actors
+typedef struct CoSched{
+  Bank* b;
+  EventQueue events; // Wakeups of sleeping tellers and the generator
+  CoTeller* tellers;
+  int* parked; // Tellers waiting on an empty line, in the order they parked
+  int parkedHead; // Index in parked of the longest waiting teller
+  int parkedCount;
+  CoGen gen;
+  CoCustomer* freeFrames; // Finished customer frames ready for reuse
+  long frames; // Customer frames ever allocated, the peak live customers
+  TraceRing* trace;
+}CoSched;
+
+// Frame for a new customer coroutine
+CoCustomer* coCustomerAlloc(CoSched* s) {
+  CoCustomer* c = s->freeFrames;
+  if(c != NULL) {
+    s->freeFrames = c->nextFree;
+  } else {
+    c = (CoCustomer*)malloc(sizeof(CoCustomer));
+    assert(c != NULL);
+    s->frames++;
+  }
+  c->resume = 0;
+  return c;
+}
+
+// co_await queue.pop() on behalf of an idle teller: bind the head customer
+// to the teller that has been parked longest and wake it this second
+void coWakeTeller(CoSched* s) {
+  int id;
+  if(s->parkedCount == 0 || s->b->customers.q.depth == 0) return;
+  id = s->parked[s->parkedHead];
+  s->parkedHead = (s->parkedHead + 1) % s->b->cfg.tellers;
+  s->parkedCount--;
+  s->tellers[id].cust = (CoCustomer*)dequeue(&s->b->customers.q);
+  schedule(&s->events, s->b->clock.secs, EV_SERVICE_START, id, NULL);
+}
+
+// Customer: join the line, wait to be served, leave
+int coCustomer(CoSched* s, CoCustomer* c) {
+  Bank* b = s->b;
+  int depth;
+  CO_BEGIN(c);
+  c->cust.startWaitTime = b->clock.secs;
+  traceEvent(s->trace, b->clock.secs, TR_ARRIVAL, 0, c->cust.id, c->cust.transTime);
+  depth = enqueue(&c->cust, &b->customers.q);
+  metricRecord(&b->depth, depth);
+  traceEvent(s->trace, b->clock.secs, TR_ENQUEUE, 0, c->cust.id, depth);
+  coWakeTeller(s);
+  CO_YIELD(c); // Until the teller is done with us
+  CO_END(c);
+}
+
+// Teller: take the next customer, serve them, repeat
+int coTeller(CoSched* s, CoTeller* t) {
+  Bank* b = s->b;
+  TellerStats* st = &b->tellerStats[t->id];
+  CO_BEGIN(t);
+  for(;;) {
+    t->idleSince = b->clock.secs;
+    traceEvent(s->trace, b->clock.secs, TR_TELLER_IDLE, t->id + 1, -1, 0);
+    t->cust = (CoCustomer*)dequeue(&b->customers.q);
+    if(t->cust == NULL) {
+      s->parked[(s->parkedHead + s->parkedCount++) % b->cfg.tellers] = t->id;
+      CO_YIELD(t); // co_await queue.pop(), the waker binds t->cust
+    }
+    metricRecord(&st->custWait, b->clock.secs - t->cust->cust.startWaitTime);
+    metricRecord(&st->tellWait, b->clock.secs - t->idleSince);
+    metricRecord(&st->transTime, t->cust->cust.transTime);
+    traceEvent(s->trace, b->clock.secs, TR_SERVICE_START, t->id + 1, t->cust->cust.id,
+      b->clock.secs - t->cust->cust.startWaitTime);
+    // co_await clock.sleep(transTime)
+    schedule(&s->events, b->clock.secs + t->cust->cust.transTime, EV_SERVICE_END, t->id, NULL);
+    CO_YIELD(t);
+    traceEvent(s->trace, b->clock.secs, TR_SERVICE_END, t->id + 1, t->cust->cust.id, t->cust->cust.transTime);
+    if(coCustomer(s, t->cust)) {
+      t->cust->nextFree = s->freeFrames;
+      s->freeFrames = t->cust;
+    }
+  }
+  CO_END(t);
+}
+
+// Generator: sleep an arrival gap, start a customer, until the bank closes
+int coGenerator(CoSched* s, CoGen* g) {
+  Bank* b = s->b;
+  CoCustomer* c;
+  int gap;
+  CO_BEGIN(g);
+  for(;;) {
+    if(!sourceNext(&g->source, &gap)) break; // Replayed log ran out
+    // co_await clock.sleep(gap)
+    schedule(&s->events, b->clock.secs + gap, EV_ARRIVAL, -1, NULL);
+    CO_YIELD(g);
+    c = coCustomerAlloc(s);
+    c->cust.id = g->id++;
+    c->cust.transTime = g->source.service;
+    coCustomer(s, c); // Runs until it is waiting in line
+    // Like customerGen, only stop once the bank has closed
+    if(b->closed) break;
+  }
+  CO_END(g);
+}
+
+// Coroutine version of the bank day
+// Tellers, customers and the generator are stackless coroutines resumed by
+// one thread in event time order, ties broken as in runEvents so both
+// engines report the same stats for the same streams (shared line only)
+void runCoroutines(Bank* b) {
+  CoSched s;
+  CoCustomer* c;
+  Event ev;
+  int i;
+
+  bankSetup(b);
+  memset(&s, 0, sizeof(CoSched));
+  s.b = b;
+  s.tellers = (CoTeller*)calloc(b->cfg.tellers, sizeof(CoTeller));
+  s.parked = (int*)malloc(b->cfg.tellers * sizeof(int));
+  assert(s.tellers != NULL && s.parked != NULL);
+  s.trace = traceAttach(b->trace, 1);
+  b->closed = 0;
+  b->clock.secs = 0;
+  memset(&b->customers.q, 0, sizeof(Queue));
+  resetStats(b);
+  s.gen.id = 1;
+  sourceInit(&s.gen.source, &b->cfg, b->replication);
+
+  if(!b->quiet) printf("Bank opening\n");
+  schedule(&s.events, b->cfg.openHours * 60 * 60 + 1, EV_CLOSE, -1, NULL);
+  for(i = 0; i < b->cfg.tellers; i++) {
+    s.tellers[i].id = i;
+    coTeller(&s, &s.tellers[i]); // Parks on the empty line
+  }
+  coGenerator(&s, &s.gen);
+  while(nextEvent(&s.events, &ev)) {
+    b->clock.secs = ev.time;
+    switch(ev.type) {
+      case EV_ARRIVAL:
+        coGenerator(&s, &s.gen);
+        break;
+      case EV_SERVICE_START:
+      case EV_SERVICE_END:
+        coTeller(&s, &s.tellers[ev.teller]);
+        break;
+      case EV_CLOSE:
+        b->closed = 1;
+        if(!b->quiet) printf("Bank Closing\n");
+        break;
+      case EV_TRANSFER:
+        break; // Only multi-branch event engine days redirect customers
+    }
+  }
+  if(!b->quiet) {
+    printf("Coroutines: %d tellers, %d customers, %ld customer frames at peak (%zu bytes each)\n",
+      b->cfg.tellers, s.gen.id - 1, s.frames, sizeof(CoCustomer));
+  }
+
+  // Customers still in line at the end were never served
+  while((c = (CoCustomer*)dequeue(&b->customers.q)) != NULL) {
+    c->nextFree = s.freeFrames;
+    s.freeFrames = c;
+  }
+  while(s.freeFrames != NULL) {
+    c = s.freeFrames;
+    s.freeFrames = c->nextFree;
+    free(c);
+  }
+  traceDetach(s.trace);
+  free(s.tellers);
+  free(s.parked);
+  free(s.events.heap);
+}
+
+// Number of CPUs available to run replications on
+int cpuCount() {
+#ifdef __QNX__
+  return _syspage_ptr->num_cpu;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+#endif
+}
+
+// Work shared by the replication threads
+typedef struct Replications{
+  int first; // Replication number of the first day
+  int count; // Days to simulate
+  Config* cfg; // Parameters every replication runs with
+  int next; // Next day to claim (atomic)
+  Summary* results; // One summary per day, indexed by replication - first
+}Replications;
+
+// Replication worker, claims days until none are left
+void* replicationWorker(void* arg) {
+  Replications* reps = (Replications*)arg;
+  Bank* b = (Bank*)cacheAlloc(sizeof(Bank));
+  int rep;
+  assert(b != NULL);
+  b->quiet = 1;
+  b->cfg = *reps->cfg;
+  for(;;) {
+    rep = __atomic_fetch_add(&reps->next, 1, __ATOMIC_RELAXED);
+    if(rep >= reps->count) break;
+    b->replication = reps->first + rep;
+    runEvents(b);
+    summarize(b, &reps->results[rep]);
+    poolRelease(&b->pool);
+  }
+  bankFree(b);
+  free(b);
+  return NULL;
+}
+
+// Run replications first..first+count-1 across threads, filling results[0..count)
+// Results only depend on cfg, first and count, not on thread count or scheduling
+void replicate(Config* cfg, int first, int count, int threads, Summary* results) {
+  Replications reps;
+  pthread_t* workers;
+  int i;
+
+  if(threads < 1) threads = cpuCount();
+  reps.first = first;
+  reps.count = count;
+  reps.cfg = cfg;
+  reps.next = 0;
+  reps.results = results;
+  workers = (pthread_t*)malloc(threads * sizeof(pthread_t));
+  assert(workers != NULL);
+  for(i = 0; i < threads; i++) pthread_create(&workers[i], NULL, &replicationWorker, &reps);
+  for(i = 0; i < threads; i++) pthread_join(workers[i], NULL);
+  free(workers);
+}
+
+// Mean and 95% confidence half-width of one figure across replications
+double summaryMean(Summary* results, int count, SummaryField f, double* half) {
+  double mean = 0;
+  double var = 0;
+  int i;
+  for(i = 0; i < count; i++) mean += results[i].v[f];
+  mean /= count;
+  for(i = 0; i < count; i++) var += (results[i].v[f] - mean) * (results[i].v[f] - mean);
+  if(half != NULL) *half = count > 1 ? 1.96 * sqrt(var / (count - 1) / count) : 0;
+  return mean;
+}
+
+// Run count days and print mean and 95% CI of each stats() figure
+void runReplications(Config* cfg, int count, int threads) {
+  Summary* results = (Summary*)malloc(count * sizeof(Summary));
+  double mean;
+  double half;
+  uint64_t start;
+  uint64_t elapsed;
+  int f;
+
+  assert(results != NULL);
+  if(threads < 1) threads = cpuCount();
+  start = nowNanos();
+  replicate(cfg, 0, count, threads, results);
+  elapsed = nowNanos() - start;
+
+  // Aggregated in replication order so the output is reproducible
+  printf("%d replications on %d threads in %.3f ms (%.0f days/sec)\n", count, threads,
+    elapsed / 1e6, count / (elapsed / 1e9));
+  printf("%-22s %12s %12s %12s\n", "metric", "mean", "ci95 low", "ci95 high");
+  for(f = 0; f < S_COUNT; f++) {
+    mean = summaryMean(results, count, f, &half);
+    printf("%-22s %12.2f %12.2f %12.2f\n", summaryNames[f], mean, mean - half, mean + half);
+  }
+  free(results);
+}
+
+// Outcome of testing one teller count against the wait SLA
+typedef struct StaffTrial{
+  int tellers;
+  int reps; // Days run before deciding
+  double p95; // Mean over days of p95 customer wait
+  double half; // 95% confidence half-width of p95
+  int feasible; // Boolean whether the count meets the SLA
+  int decided; // Boolean whether the interval cleared the SLA, not just the mean
+}StaffTrial;
+
+// Run batches of days at cfg->tellers until the p95 wait interval sits clearly
+// on one side of slaSecs, or STAFF_MAX_REPS days leave it to the mean
+// Every count sees the same replication numbers, so counts are compared on
+// the same arrival and service streams
+void staffTrial(Config* cfg, double slaSecs, int threads, Summary* results, StaffTrial* trial) {
+  int reps = 0;
+  double mean;
+  double half;
+  for(;;) {
+    replicate(cfg, reps, STAFF_BATCH, threads, results + reps);
+    reps += STAFF_BATCH;
+    mean = summaryMean(results, reps, S_P95_CUST_WAIT, &half);
+    if(mean + half < slaSecs || mean - half >= slaSecs || reps >= STAFF_MAX_REPS) break;
+  }
+  trial->tellers = cfg->tellers;
+  trial->reps = reps;
+  trial->p95 = mean;
+  trial->half = half;
+  trial->feasible = mean < slaSecs;
+  trial->decided = mean + half < slaSecs || mean - half >= slaSecs;
+  printf("%7d %6d %12.1f %10.1f  %s%s\n", trial->tellers, trial->reps, trial->p95, trial->half,
+    trial->feasible ? "meets SLA" : "misses SLA", trial->decided ? "" : " (by mean)");
+}
+
+// Find the fewest tellers whose p95 customer wait stays under slaMinutes
+// Doubles from cfg.tellers until a count meets the SLA, then bisects down,
+// assuming waits only shrink as tellers are added
+void optimizeStaff(Config* base, double slaMinutes, int threads) {
+  Summary* results = (Summary*)malloc(STAFF_MAX_REPS * sizeof(Summary));
+  Config cfg = *base;
+  StaffTrial trial;
+  double slaSecs = slaMinutes * 60;
+  int lo = 0; // Largest count known to miss
+  int hi = base->tellers; // Smallest count known to meet, once found
+  uint64_t start = nowNanos();
+
+  assert(results != NULL);
+  printf("Target: p95 customer wait under %.1f min (%.0f secs)\n", slaMinutes, slaSecs);
+  printf("%7s %6s %12s %10s  %s\n", "tellers", "days", "p95 wait", "ci95 +/-", "verdict");
+  for(;;) {
+    cfg.tellers = hi;
+    staffTrial(&cfg, slaSecs, threads, results, &trial);
+    if(trial.feasible) break;
+    lo = hi;
+    hi *= 2;
+    if(hi > STAFF_MAX_TELLERS) {
+      printf("No staffing up to %d tellers meets the SLA\n", STAFF_MAX_TELLERS);
+      free(results);
+      return;
+    }
+  }
+  while(hi - lo > 1) {
+    cfg.tellers = lo + (hi - lo) / 2;
+    staffTrial(&cfg, slaSecs, threads, results, &trial);
+    if(trial.feasible) hi = cfg.tellers;
+    else lo = cfg.tellers;
+  }
+  printf("Cheapest staffing meeting the SLA: %d tellers (searched in %.3f ms)\n", hi,
+    (nowNanos() - start) / 1e6);
+  free(results);
+}
+
+// Regional network of branches, simulated by shards with one thread each
+// Branch i lives on shard i % shards. Every shard runs its branches to the end
+// of a lookahead window of transferSecs, then all meet at a barrier and deliver
+// the transfers sent during it. A transfer lands at least transferSecs after it
+// was sent, so it always falls in a later window and no shard sees its past.
+typedef struct Network{
+  int count; // Branches
+  int shards;
+  Bank** banks;
+  EventDay* days; // Indexed by branch
+  Mailbox* boxes; // Indexed by sending branch
+  pthread_barrier_t barrier;
+  int active[2]; // Shards with events left, by window parity
+  int windows; // Windows run
+}Network;
+
+// Shard thread handle
+typedef struct Shard{
+  int id;
+  Network* net;
+  pthread_t thread;
+}Shard;
+
+// Delivery order: destination, arrival time, origin, then send order
+// Does not depend on which shard sent what, so sharding never changes results
+int transferBefore(const void* a, const void* b) {
+  const Transfer* x = (const Transfer*)a;
+  const Transfer* y = (const Transfer*)b;
+  if(x->branch != y->branch) return x->branch - y->branch;
+  if(x->time != y->time) return x->time - y->time;
+  if(x->from != y->from) return x->from - y->from;
+  return x->seq - y->seq;
+}
+
+// Move transfers addressed to this shard's branches into their event queues
+void shardDeliver(Shard* sh, Transfer** buf, int* cap) {
+  Network* net = sh->net;
+  Customer* cust;
+  Bank* b;
+  Mailbox* box;
+  int n = 0;
+  int from;
+  int i;
+  for(from = 0; from < net->count; from++) {
+    if(net->days[from].redirectTo % net->shards != sh->id) continue;
+    box = &net->boxes[from];
+    if(n + box->count > *cap) {
+      while(n + box->count > *cap) *cap *= 2;
+      *buf = (Transfer*)realloc(*buf, *cap * sizeof(Transfer));
+      assert(*buf != NULL);
+    }
+    memcpy(&(*buf)[n], box->slots, box->count * sizeof(Transfer));
+    n += box->count;
+  }
+  qsort(*buf, n, sizeof(Transfer), transferBefore);
+  for(i = 0; i < n; i++) {
+    b = net->banks[(*buf)[i].branch];
+    cust = poolAlloc(&b->pool, &net->days[(*buf)[i].branch].cache);
+    cust->next = NULL;
+    cust->id = (*buf)[i].id;
+    cust->startWaitTime = (*buf)[i].startWaitTime;
+    cust->transTime = (*buf)[i].transTime;
+    schedule(&net->days[(*buf)[i].branch].events, (*buf)[i].time, EV_TRANSFER, -1, cust);
+  }
+}
+
+// Shard thread function, runs its branches window by window until every
+// branch in the network has finished its day
+void* shardWorker(void* arg) {
+  Shard* sh = (Shard*)arg;
+  Network* net = sh->net;
+  int cap = 256;
+  Transfer* buf = (Transfer*)malloc(cap * sizeof(Transfer));
+  int lookahead;
+  int window;
+  int pending;
+  int i;
+
+  assert(buf != NULL);
+  for(i = sh->id; i < net->count; i += net->shards) {
+    eventDayStart(net->banks[i], &net->days[i]);
+    net->days[i].branch = i;
+    net->days[i].redirectTo = (i + 1) % net->count;
+    if(net->count > 1) net->days[i].outbox = &net->boxes[i];
+  }
+  lookahead = net->banks[sh->id]->cfg.transferSecs;
+  for(window = 0;; window++) {
+    pending = 0;
+    for(i = sh->id; i < net->count; i += net->shards) {
+      net->boxes[i].count = 0; // Delivered last window
+      eventDayRun(net->banks[i], &net->days[i], (window + 1) * lookahead);
+    }
+    pthread_barrier_wait(&net->barrier); // Every transfer of the window is sent
+    shardDeliver(sh, &buf, &cap);
+    for(i = sh->id; i < net->count; i += net->shards) pending |= net->days[i].events.size > 0;
+    if(pending) __atomic_add_fetch(&net->active[window & 1], 1, __ATOMIC_RELAXED);
+    if(sh->id == 0) net->active[(window + 1) & 1] = 0; // Nobody reads it until next window
+    pthread_barrier_wait(&net->barrier); // Every shard has reported
+    if(__atomic_load_n(&net->active[window & 1], __ATOMIC_RELAXED) == 0) break;
+  }
+  if(sh->id == 0) net->windows = window + 1;
+  for(i = sh->id; i < net->count; i += net->shards) eventDayEnd(net->banks[i], &net->days[i]);
+  free(buf);
+  return NULL;
+}
+
+// Simulate one day of a network of branches on up to threads shards, each
+// branch with its own clock, line, tellers and random streams
+// Leaves every branch's bank and day in net, release them with networkFree
+void networkSimulate(Network* net, Config* cfg, int branches, int threads) {
+  Shard* shards;
+  int i;
+
+  if(threads < 1) threads = cpuCount();
+  memset(net, 0, sizeof(Network));
+  net->count = branches;
+  net->shards = threads < branches ? threads : branches;
+  net->banks = (Bank**)malloc(branches * sizeof(Bank*));
+  net->days = (EventDay*)calloc(branches, sizeof(EventDay));
+  net->boxes = (Mailbox*)calloc(branches, sizeof(Mailbox));
+  shards = (Shard*)calloc(net->shards, sizeof(Shard));
+  assert(net->banks != NULL && net->days != NULL && net->boxes != NULL && shards != NULL);
+  for(i = 0; i < branches; i++) {
+    net->banks[i] = (Bank*)cacheAlloc(sizeof(Bank));
+    assert(net->banks[i] != NULL);
+    net->banks[i]->cfg = *cfg;
+    net->banks[i]->quiet = 1;
+    net->banks[i]->replication = i; // Own random streams per branch
+  }
+  pthread_barrier_init(&net->barrier, NULL, net->shards);
+
+  for(i = 0; i < net->shards; i++) {
+    shards[i].id = i;
+    shards[i].net = net;
+    pthread_create(&shards[i].thread, NULL, &shardWorker, &shards[i]);
+  }
+  for(i = 0; i < net->shards; i++) pthread_join(shards[i].thread, NULL);
+  pthread_barrier_destroy(&net->barrier);
+  free(shards);
+}
+
+// Release what networkSimulate left in net
+void networkFree(Network* net) {
+  int i;
+  for(i = 0; i < net->count; i++) {
+    poolRelease(&net->banks[i]->pool);
+    bankFree(net->banks[i]);
+    free(net->banks[i]);
+    free(net->boxes[i].slots);
+  }
+  free(net->boxes);
+  free(net->days);
+  free(net->banks);
+}
+
+// Simulate one day of a network of branches, then print per-branch and
+// network-wide stats
+void runNetwork(Config* cfg, int branches, int threads) {
+  Network net;
+  Bank* all;
+  Summary sum;
+  uint64_t start;
+  uint64_t elapsed;
+  int sent = 0;
+  int refused = 0;
+  int i;
+
+  start = nowNanos();
+  networkSimulate(&net, cfg, branches, threads);
+  elapsed = nowNanos() - start;
+
+  // Network-wide figures come from one bank holding every teller's stats
+  all = (Bank*)cacheAlloc(sizeof(Bank));
+  assert(all != NULL);
+  all->cfg = *cfg;
+  all->cfg.tellers = branches * cfg->tellers;
+  all->tellerStats = (TellerStats*)cacheAlloc(all->cfg.tellers * sizeof(TellerStats));
+  assert(all->tellerStats != NULL);
+  printf("%-8s %8s %6s %9s %8s %9s %9s %9s\n", "branch", "served", "sent", "received", "refused",
+    "avg wait", "p95 wait", "day secs");
+  for(i = 0; i < branches; i++) {
+    summarize(net.banks[i], &sum);
+    printf("%-8d %8d %6d %9d %8d %9.1f %9d %9d\n", i, (int)sum.v[S_SERVED], net.days[i].sent,
+      net.days[i].received, net.days[i].refused, sum.v[S_AVG_CUST_WAIT], (int)sum.v[S_P95_CUST_WAIT],
+      (int)sum.v[S_DAY_SECS]);
+    memcpy(&all->tellerStats[i * cfg->tellers], net.banks[i]->tellerStats, cfg->tellers * sizeof(TellerStats));
+    metricMerge(&all->depth, &net.banks[i]->depth);
+    if(net.banks[i]->clock.secs > all->clock.secs) all->clock.secs = net.banks[i]->clock.secs;
+    sent += net.days[i].sent;
+    refused += net.days[i].refused;
+  }
+  printf("All %d branches:\n", branches);
+  stats(all);
+  printf("%d branches on %d shards: %d windows of %d secs, %d transfers, %d refused, %.3f ms\n",
+    branches, net.shards, net.windows, cfg->transferSecs, sent, refused, elapsed / 1e6);
+
+  free(all->tellerStats);
+  free(all);
+  networkFree(&net);
+}
+
+// Process CPU time in nanoseconds, summed over all threads
+uint64_t cpuNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Sweep teller count and arrival rate, writing one CSV row per combination
+// Arrivals are Poisson (exp:0:mean) so the rate is the only thing that changes
+void benchSweep(Config* base) {
+  int means[] = {30, 60, 90, 120, 150, 180};
+  int reps = 200;
+  Summary* results = (Summary*)malloc(reps * sizeof(Summary));
+  Config cfg;
+  uint64_t cpu;
+  double served;
+  double hours;
+  int tellers;
+  int m;
+
+  assert(results != NULL);
+  printf("tellers,arrival_mean_secs,replications,served_per_hour,max_depth,"
+    "p50_wait,p90_wait,p99_wait,cpu_us_per_sim_hour\n");
+  for(tellers = 1; tellers <= 3 * base->tellers; tellers++) {
+    for(m = 0; m < sizeof(means) / sizeof(means[0]); m++) {
+      cfg = *base;
+      cfg.tellers = tellers;
+      cfg.arrive.type = DIST_EXPONENTIAL;
+      cfg.arrive.min = 0;
+      cfg.arrive.mean = means[m];
+      cfg.arrive.k = 1;
+      cpu = cpuNanos();
+      replicate(&cfg, 0, reps, 0, results);
+      cpu = cpuNanos() - cpu;
+      // Days run past closing until the queue drains, so rate by simulated time
+      served = summaryMean(results, reps, S_SERVED, NULL);
+      hours = summaryMean(results, reps, S_DAY_SECS, NULL) / 3600.0;
+      printf("%d,%d,%d,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n", tellers, means[m], reps,
+        served / hours,
+        summaryMean(results, reps, S_MAX_DEPTH, NULL),
+        summaryMean(results, reps, S_P50_CUST_WAIT, NULL),
+        summaryMean(results, reps, S_P90_CUST_WAIT, NULL),
+        summaryMean(results, reps, S_P99_CUST_WAIT, NULL),
+        cpu / 1e3 / (hours * reps));
+    }
+  }
+  free(results);
+}
+
+// Time enqueue/dequeue per operation at growing queue depths
+void benchQueue() {
+  int sizes[] = {1000, 10000, 100000, 1000000};
+  Customer* custs = NULL;
+  Queue q;
+  uint64_t start;
+  uint64_t enqTime;
+  uint64_t deqTime;
+  int n;
+  int i;
+  int s;
+
+  printf("customers,enqueue_ns_per_op,dequeue_ns_per_op\n");
+  for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    n = sizes[s];
+    custs = (Customer*)malloc(n * sizeof(Customer));
+    assert(custs != NULL);
+    memset(custs, 0, n * sizeof(Customer)); // Fault pages in before timing
+    memset(&q, 0, sizeof(Queue));
+    start = nowNanos();
+    for(i = 0; i < n; i++) enqueue(&custs[i], &q);
+    enqTime = nowNanos() - start;
+    start = nowNanos();
+    for(i = 0; i < n; i++) dequeue(&q);
+    deqTime = nowNanos() - start;
+    assert(q.depth == 0);
+    printf("%d,%.2f,%.2f\n", n, (double)enqTime / n, (double)deqTime / n);
+    free(custs);
+  }
+}
+
+// Consumer side of the queue scaling benchmark, mirrors teller()
+void* benchConsumer(void* arg) {
+  for(;;) {
+    sem_wait(&bank.customers.semaphore);
+    if(getNextCust(&bank, 0) == NULL) break;
+  }
+  return NULL;
+}
+
+// Throughput of the mutex queue vs the lock-free ring from 1 to 64 tellers
+void benchMpmc() {
+  int counts[] = {1, 2, 4, 8, 16, 32, 64};
+  int n = 200000;
+  Customer* custs = (Customer*)malloc(n * sizeof(Customer));
+  pthread_t threads[64];
+  uint64_t start;
+  uint64_t elapsed;
+  int lockFree;
+  int c;
+  int i;
+
+  assert(custs != NULL);
+  memset(custs, 0, n * sizeof(Customer));
+  printf("queue,tellers,customers,ns_per_customer,customers_per_sec\n");
+  for(lockFree = 0; lockFree < 2; lockFree++) {
+    for(c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+      pthread_mutex_init(&bank.customers.lock, NULL);
+      memset(&bank.customers.q, 0, sizeof(Queue));
+      ringInit(&bank.customers.ring);
+      bank.customers.lockFree = lockFree;
+      sem_init(&bank.customers.semaphore, 0, 0);
+      for(i = 0; i < counts[c]; i++) {
+        pthread_create(&threads[i], NULL, &benchConsumer, NULL);
+      }
+      start = nowNanos();
+      for(i = 0; i < n; i++) addCustomer(&bank, &custs[i]);
+      for(i = 0; i < counts[c]; i++) sem_post(&bank.customers.semaphore); // Closing, same as runBank
+      for(i = 0; i < counts[c]; i++) pthread_join(threads[i], NULL);
+      elapsed = nowNanos() - start;
+      printf("%s,%d,%d,%.1f,%.0f\n", lockFree ? "lockfree" : "mutex", counts[c], n,
+        (double)elapsed / n, n / (elapsed / 1e9));
+      sem_destroy(&bank.customers.semaphore);
+      pthread_mutex_destroy(&bank.customers.lock);
+    }
+  }
+  free(custs);
+}
+
+// Per-customer malloc + mutex setup vs the slab pool with bulk release
+void benchAlloc() {
+  int n = 1000000;
+  Customer** custs = (Customer**)malloc(n * sizeof(Customer*));
+  pthread_mutex_t* locks = (pthread_mutex_t*)malloc(n * sizeof(pthread_mutex_t));
+  CustomerPool pool;
+  PoolCache cache;
+  uint64_t start;
+  uint64_t allocTime;
+  uint64_t freeTime;
+  int i;
+
+  assert(custs != NULL && locks != NULL);
+  printf("allocator,customers,allocator_calls,alloc_ns_per_customer,release_ns_per_customer\n");
+
+  // What customerGen/stats used to do
+  start = nowNanos();
+  for(i = 0; i < n; i++) {
+    custs[i] = (Customer*)malloc(sizeof(Customer));
+    custs[i]->id = i;
+    pthread_mutex_init(&locks[i], NULL);
+  }
+  allocTime = nowNanos() - start;
+  start = nowNanos();
+  for(i = 0; i < n; i++) {
+    pthread_mutex_destroy(&locks[i]);
+    free(custs[i]);
+  }
+  freeTime = nowNanos() - start;
+  printf("malloc,%d,%d,%.2f,%.2f\n", n, 2 * n, (double)allocTime / n, (double)freeTime / n);
+
+  poolInit(&pool);
+  poolCacheInit(&cache);
+  start = nowNanos();
+  for(i = 0; i < n; i++) {
+    custs[i] = poolAlloc(&pool, &cache);
+    custs[i]->id = i;
+  }
+  allocTime = nowNanos() - start;
+  poolCacheDone(&pool, &cache);
+  start = nowNanos();
+  poolRelease(&pool);
+  freeTime = nowNanos() - start;
+  printf("pool,%ld,%ld,%.2f,%.2f\n", pool.allocs, 2 * pool.slabAllocs, (double)allocTime / n, (double)freeTime / n);
+
+  free(locks);
+  free(custs);
+}
+
+// Draw rate of rand_r modulo vs the batched counter-based samplers
+void benchRng() {
+  const char* specs[] = {"uniform:30:360", "exp:30:195", "erlang:30:195:3"};
+  int n = 10000000;
+  unsigned int seed = 12;
+  Sampler sampler;
+  Dist dist;
+  uint64_t start;
+  uint64_t elapsed;
+  long long sum = 0;
+  int d;
+  int i;
+
+  printf("generator,draws,ns_per_draw,draws_per_sec,mean\n");
+  start = nowNanos();
+  for(i = 0; i < n; i++) sum += 30 + rand_r(&seed) % (360 - 30);
+  elapsed = nowNanos() - start;
+  printf("rand_r,%d,%.2f,%.0f,%.2f\n", n, (double)elapsed / n, n / (elapsed / 1e9), (double)sum / n);
+
+  for(d = 0; d < sizeof(specs) / sizeof(specs[0]); d++) {
+    parseDist(specs[d], &dist);
+    samplerInit(&sampler, &dist, 1, 0, STREAM_SERVICE);
+    sum = 0;
+    start = nowNanos();
+    for(i = 0; i < n; i++) sum += sampleNext(&sampler);
+    elapsed = nowNanos() - start;
+    printf("%s,%d,%.2f,%.0f,%.2f\n", specs[d], n, (double)elapsed / n, n / (elapsed / 1e9), (double)sum / n);
+  }
+}
+
+// Hot bank fields laid out the way Bank used to pack them
+typedef struct PackedHot{
+  int secs; // Clock thread writes every tick
+  int closed; // Everyone else reads
+  pthread_mutex_t lock; // Tellers and generator take
+  int depth; // Written under lock
+}PackedHot;
+
+// The same fields a cache line apart, the way Bank lays them out now
+typedef struct PaddedHot{
+  int secs CACHE_ALIGNED;
+  int closed CACHE_ALIGNED;
+  pthread_mutex_t lock CACHE_ALIGNED;
+  int depth;
+}PaddedHot;
+
+// Pointers into one of the layouts for the benchmark threads
+typedef struct HotFields{
+  int* secs;
+  int* closed;
+  pthread_mutex_t* lock;
+  int* depth;
+  int iters; // Lock round trips per worker
+  int stop; // Tells the ticking thread to finish
+}HotFields;
+
+// Stand-in clock thread, bumps secs as fast as it can
+void* falseShareTicker(void* arg) {
+  HotFields* hot = (HotFields*)arg;
+  while(!__atomic_load_n(&hot->stop, __ATOMIC_RELAXED)) {
+    __atomic_store_n(hot->secs, *hot->secs + 1, __ATOMIC_RELAXED);
+  }
+  return NULL;
+}
+
+// Stand-in teller, the closed check, lock and secs read of each hand-off
+void* falseShareWorker(void* arg) {
+  HotFields* hot = (HotFields*)arg;
+  int seen = 0;
+  int i;
+  for(i = 0; i < hot->iters; i++) {
+    if(__atomic_load_n(hot->closed, __ATOMIC_RELAXED)) break;
+    pthread_mutex_lock(hot->lock);
+    (*hot->depth)++;
+    pthread_mutex_unlock(hot->lock);
+    seen += __atomic_load_n(hot->secs, __ATOMIC_RELAXED) & 1;
+  }
+  return (void*)(intptr_t)seen;
+}
+
+// Open a process-wide hardware counter inherited by threads created after it,
+// returns -1 where perf events are unavailable
+int perfOpen(uint64_t config) {
+#ifdef __linux__
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+// Cache misses of one clock thread plus workers on the packed vs padded layout
+void benchFalseShare() {
+  PackedHot* packed = (PackedHot*)cacheAlloc(sizeof(PackedHot));
+  PaddedHot* padded = (PaddedHot*)cacheAlloc(sizeof(PaddedHot));
+  HotFields hot;
+  pthread_t ticker;
+  pthread_t workers[8];
+  int nWorkers = cpuCount() - 1;
+#ifdef __linux__
+  int missFd = perfOpen(PERF_COUNT_HW_CACHE_MISSES);
+  int refFd = perfOpen(PERF_COUNT_HW_CACHE_REFERENCES);
+#else
+  int missFd = -1; // No perf events, time only
+  int refFd = -1;
+#endif
+  long long misses = -1;
+  long long refs = -1;
+  uint64_t start;
+  uint64_t elapsed;
+  int layout;
+  int i;
+
+  assert(packed != NULL && padded != NULL);
+  if(nWorkers < 1) nWorkers = 1;
+  if(nWorkers > 8) nWorkers = 8;
+  pthread_mutex_init(&packed->lock, NULL);
+  pthread_mutex_init(&padded->lock, NULL);
+  if(missFd < 0) fprintf(stderr, "cache miss counter unavailable, reporting time only\n");
+  printf("layout,workers,ops,ns_per_op,cache_misses,cache_references,misses_per_op\n");
+  for(layout = 0; layout < 2; layout++) {
+    hot.secs = layout ? &padded->secs : &packed->secs;
+    hot.closed = layout ? &padded->closed : &packed->closed;
+    hot.lock = layout ? &padded->lock : &packed->lock;
+    hot.depth = layout ? &padded->depth : &packed->depth;
+    hot.iters = 2000000;
+    hot.stop = 0;
+#ifdef __linux__
+    if(missFd >= 0) {
+      ioctl(missFd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(missFd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    if(refFd >= 0) {
+      ioctl(refFd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(refFd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    start = nowNanos();
+    pthread_create(&ticker, NULL, &falseShareTicker, &hot);
+    for(i = 0; i < nWorkers; i++) pthread_create(&workers[i], NULL, &falseShareWorker, &hot);
+    for(i = 0; i < nWorkers; i++) pthread_join(workers[i], NULL);
+    __atomic_store_n(&hot.stop, 1, __ATOMIC_RELAXED);
+    pthread_join(ticker, NULL); // Exited threads' counts fold into the inherited counter
+    elapsed = nowNanos() - start;
+#ifdef __linux__
+    if(missFd >= 0) {
+      ioctl(missFd, PERF_EVENT_IOC_DISABLE, 0);
+      if(read(missFd, &misses, sizeof(misses)) != sizeof(misses)) misses = -1;
+    }
+    if(refFd >= 0) {
+      ioctl(refFd, PERF_EVENT_IOC_DISABLE, 0);
+      if(read(refFd, &refs, sizeof(refs)) != sizeof(refs)) refs = -1;
+    }
+#endif
+    printf("%s,%d,%d,%.2f,%lld,%lld,%.4f\n", layout ? "padded" : "packed", nWorkers, hot.iters * nWorkers,
+      (double)elapsed / (hot.iters * nWorkers), misses, refs,
+      misses < 0 ? -1.0 : (double)misses / (hot.iters * nWorkers));
+  }
+  if(missFd >= 0) close(missFd);
+  if(refFd >= 0) close(refFd);
+  free(packed);
+  free(padded);
+}
+
+#define ENGINE_SEEDS 5 // Seeds benchEngines runs
+#define ENGINE_SLACK 2 // Teller wait seconds the real time clock may add
+
+// Teller wait figures benchEngines compares
+const SummaryField engineFields[] = {S_SERVED, S_MAX_TELL_WAIT, S_AVG_TELL_WAIT, S_P90_TELL_WAIT};
+
+// Figures differing by more than slack, 0 if they all match
+int engineDiffers(Summary* a, Summary* b, double slack) {
+  int f;
+  for(f = 0; f < sizeof(engineFields) / sizeof(engineFields[0]); f++) {
+    if(fabs(a->v[engineFields[f]] - b->v[engineFields[f]]) > (engineFields[f] == S_SERVED ? 0 : slack)) return 1;
+  }
+  return 0;
+}
+
+// Run the same seeds through the threaded, event and coroutine engines and
+// compare what tellers saw, exits with failure if any seed differs by more
+// than clock jitter (threaded) or at all (coroutines)
+// Threaded days run in real time, -T shortens them
+void benchEngines(Config* base) {
+  Bank* b = (Bank*)cacheAlloc(sizeof(Bank));
+  Summary threaded;
+  Summary event;
+  Summary coroutines;
+  int failures = 0;
+  int differs;
+  int seed;
+
+  assert(b != NULL);
+  if(base->discipline != DISC_SHARED) {
+    fprintf(stderr, "Coroutine engine only models the shared line\n");
+    exit(EXIT_FAILURE);
+  }
+  printf("seed,engine,served,max_tell_wait,avg_tell_wait,p90_tell_wait,match\n");
+  for(seed = 0; seed < ENGINE_SEEDS; seed++) {
+    b->cfg = *base;
+    b->cfg.seed = base->seed + seed;
+    b->quiet = 1;
+    openBank(b);
+    closeBank(b);
+    summarize(b, &threaded);
+    poolRelease(&b->pool);
+    runEvents(b);
+    summarize(b, &event);
+    poolRelease(&b->pool);
+    runCoroutines(b);
+    summarize(b, &coroutines);
+    differs = engineDiffers(&threaded, &event, ENGINE_SLACK) || engineDiffers(&coroutines, &event, 0);
+    failures += differs;
+    printf("%llu,event,%d,%d,%d,%d,\n", (unsigned long long)b->cfg.seed, (int)event.v[S_SERVED],
+      (int)event.v[S_MAX_TELL_WAIT], (int)event.v[S_AVG_TELL_WAIT], (int)event.v[S_P90_TELL_WAIT]);
+    printf("%llu,coroutines,%d,%d,%d,%d,%s\n", (unsigned long long)b->cfg.seed, (int)coroutines.v[S_SERVED],
+      (int)coroutines.v[S_MAX_TELL_WAIT], (int)coroutines.v[S_AVG_TELL_WAIT], (int)coroutines.v[S_P90_TELL_WAIT],
+      engineDiffers(&coroutines, &event, 0) ? "no" : "yes");
+    printf("%llu,threaded,%d,%d,%d,%d,%s\n", (unsigned long long)b->cfg.seed, (int)threaded.v[S_SERVED],
+      (int)threaded.v[S_MAX_TELL_WAIT], (int)threaded.v[S_AVG_TELL_WAIT], (int)threaded.v[S_P90_TELL_WAIT],
+      engineDiffers(&threaded, &event, ENGINE_SLACK) ? "no" : "yes");
+  }
+  bankFree(b);
+  free(b);
+  if(failures > 0) {
+    fprintf(stderr, "%d of %d seeds differ between engines\n", failures, ENGINE_SEEDS);
+    exit(EXIT_FAILURE);
+  }
+}
+
+#define NETWORK_BRANCHES 40 // Branches benchNetwork simulates
+
+// Branches whose figures or transfer counts differ between two networks
+int networkDiffers(Network* a, Network* b) {
+  Summary sa;
+  Summary sb;
+  int differs = 0;
+  int i;
+  for(i = 0; i < a->count; i++) {
+    summarize(a->banks[i], &sa);
+    summarize(b->banks[i], &sb);
+    differs += memcmp(sa.v, sb.v, sizeof(sa.v)) != 0 || a->days[i].sent != b->days[i].sent ||
+      a->days[i].received != b->days[i].received || a->days[i].refused != b->days[i].refused;
+  }
+  return differs;
+}
+
+// Transfers sent (or refused if refused is set) across the network
+int networkTotal(Network* net, int refused) {
+  int total = 0;
+  int i;
+  for(i = 0; i < net->count; i++) total += refused ? net->days[i].refused : net->days[i].sent;
+  return total;
+}
+
+// Run the same network on one shard and on several, exits with failure if
+// any branch's day depends on how branches were packed onto shards
+// Refusals need more than MAILBOX_SIZE redirects from a branch in one window,
+// e.g. -A exp:0:1 -n 1 with transfer_secs=28800 in a -f config
+void benchNetwork(Config* cfg) {
+  int shards[] = {2, 4, 0}; // 0 runs one shard per CPU
+  Network serial;
+  Network sharded;
+  int failures = 0;
+  int differs;
+  int s;
+
+  networkSimulate(&serial, cfg, NETWORK_BRANCHES, 1);
+  printf("shards,sent,refused,branches_differing\n");
+  printf("1,%d,%d,0\n", networkTotal(&serial, 0), networkTotal(&serial, 1));
+  for(s = 0; s < sizeof(shards) / sizeof(shards[0]); s++) {
+    networkSimulate(&sharded, cfg, NETWORK_BRANCHES, shards[s]);
+    differs = networkDiffers(&serial, &sharded);
+    failures += differs > 0;
+    printf("%d,%d,%d,%d\n", sharded.shards, networkTotal(&sharded, 0), networkTotal(&sharded, 1), differs);
+    networkFree(&sharded);
+  }
+  networkFree(&serial);
+  if(failures > 0) {
+    fprintf(stderr, "%d shard counts differ from one shard\n", failures);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Run a named microbenchmark, returns 0 if name is unknown
+int bench(const char* name, Config* cfg) {
+  if(strcmp(name, "queue") == 0) {
+    benchQueue();
+    return 1;
+  }
+  if(strcmp(name, "mpmc") == 0) {
+    benchMpmc();
+    return 1;
+  }
+  if(strcmp(name, "alloc") == 0) {
+    benchAlloc();
+    return 1;
+  }
+  if(strcmp(name, "rng") == 0) {
+    benchRng();
+    return 1;
+  }
+  if(strcmp(name, "sweep") == 0) {
+    benchSweep(cfg);
+    return 1;
+  }
+  if(strcmp(name, "falseshare") == 0) {
+    benchFalseShare();
+    return 1;
+  }
+  if(strcmp(name, "engines") == 0) {
+    benchEngines(cfg);
+    return 1;
+  }
+  if(strcmp(name, "network") == 0) {
+    benchNetwork(cfg);
+    return 1;
+  }
+  return 0;
+}
+
+// Apply a command line setting, exiting on a bad value
+void cliSet(Config* cfg, const char* key, const char* value) {
+  if(!configSet(cfg, key, value)) {
+    fprintf(stderr, "Bad %s: %s\n", key, value);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Print how closely the clock thread kept to its period
+void clockStats(ClockSim* clock) {
+  TickSource* ticker = &clock->ticker;
+  printf("Clock ticks: %llu, overruns: %ld, drift: %.3f ms, max drift: %.3f ms\n",
+    (unsigned long long)ticker->ticks, ticker->overruns,
+    ticker->lateNs / 1e6, ticker->maxLateNs / 1e6);
+  printf("Tick interval avg/p50/p99/max: %.3f/%.3f/%.3f/%.3f ms (period %.3f ms)\n",
+    metricAvg(&ticker->interval) / 1e6, metricPercentile(&ticker->interval, 50) / 1e6,
+    metricPercentile(&ticker->interval, 99) / 1e6, ticker->interval.max / 1e6, ticker->periodNs / 1e6);
+  printf("Late wakeups: %ld missed %ld periods, %s\n", ticker->missed, ticker->overruns,
+    clock->catchUp ? "caught up" : "simulated time stretched");
+  printf("Tick fan-out avg/p99/max: %.1f/%.1f/%.1f us\n", metricAvg(&clock->fanout) / 1e3,
+    metricPercentile(&clock->fanout, 99) / 1e3, clock->fanout.max / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+  int opt;
+  int eventMode = 0;
+  int replications = 0;
+  int threads = 0;
+  double slaMinutes = 0;
+  int branches = 0;
+  const char* benchName = NULL;
+  const char* tracePath = NULL;
+  const char* metricsName = NULL;
+  const char* resumePath = NULL;
+  Checkpoint checkpoint;
+  EventDay day;
+  uint64_t traced;
+  Config cfg;
+  uint64_t start;
+  uint64_t elapsed;
+  struct rusage usage;
+
+  configDefaults(&cfg);
+  memset(&checkpoint, 0, sizeof(Checkpoint));
+  checkpoint.every = 3600;
+  while((opt = getopt(argc, argv, "f:n:H:T:dClbcD:t:r:j:O:M:s:A:S:a:B:o:m:k:K:R:")) != -1) {
+    switch(opt) {
+      case 'f':
+        if(!loadConfig(&cfg, optarg)) return EXIT_FAILURE; // Later options still override
+        break;
+      case 'n':
+        cliSet(&cfg, "tellers", optarg);
+        break;
+      case 'H':
+        cliSet(&cfg, "hours", optarg);
+        break;
+      case 'T':
+        cliSet(&cfg, "tick_ns", optarg);
+        break;
+      case 'd':
+        eventMode = 1; // Discrete event engine instead of real time threads
+        break;
+      case 'C':
+        eventMode = 2; // Coroutine engine on one thread
+        break;
+      case 'l':
+        cfg.lockFree = 1; // Tellers share the lock-free ring
+        break;
+      case 'b':
+        cfg.useWheel = 0; // Wake every waiter on every tick
+        break;
+      case 'c':
+        cfg.catchUp = 1; // Late clock skips ahead by the periods it missed
+        break;
+      case 'D':
+        cliSet(&cfg, "discipline", optarg);
+        break;
+      case 't':
+        cliSet(&cfg, "tick", optarg);
+        break;
+      case 'r':
+        replications = atoi(optarg); // Independent event engine days
+        break;
+      case 'O':
+        slaMinutes = atof(optarg); // Staffing search for this p95 wait target
+        if(slaMinutes <= 0) {
+          fprintf(stderr, "Bad SLA minutes: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'M':
+        branches = atoi(optarg); // Sharded network of branches
+        if(branches < 1) {
+          fprintf(stderr, "Bad branch count: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'j':
+        threads = atoi(optarg); // Replication threads, default one per CPU
+        break;
+      case 's':
+        cliSet(&cfg, "seed", optarg);
+        break;
+      case 'A':
+        cliSet(&cfg, "arrival", optarg);
+        break;
+      case 'S':
+        cliSet(&cfg, "service", optarg);
+        break;
+      case 'a':
+        cliSet(&cfg, "arrival_log", optarg);
+        break;
+      case 'B':
+        benchName = optarg;
+        break;
+      case 'o':
+        tracePath = optarg; // Binary event trace, decode with tools/tracedump
+        break;
+      case 'm':
+        metricsName = optarg; // Live shared memory metrics, watch with tools/bankmon
+        break;
+      case 'k':
+        checkpoint.path = optarg; // Event engine snapshots to resume from with -R
+        break;
+      case 'K':
+        checkpoint.every = atoi(optarg);
+        if(checkpoint.every < 1) {
+          fprintf(stderr, "Bad checkpoint secs: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'R':
+        if(!snapshotConfig(&cfg, optarg)) return EXIT_FAILURE; // Later options make a what-if
+        resumePath = optarg;
+        eventMode = 1;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-f config] [-n tellers] [-H hours] [-T tick_ns] [-d|-C] [-l] [-b] [-c]"
+          " [-D shared|jsq|rr] [-t pulse|nanosleep|timerfd] [-r replications | -O sla_minutes | -M branches] [-j threads] [-s seed] [-A dist | -a arrival_log] [-S dist]"
+          " [-B benchmark] [-o tracefile] [-m shm_name] [-k snapshot [-K secs]] [-R snapshot]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if(benchName != NULL) {
+    if(bench(benchName, &cfg)) return EXIT_SUCCESS;
+    fprintf(stderr, "Unknown benchmark %s\n", benchName);
+    return EXIT_FAILURE;
+  }
+  if(branches > 0) {
+    runNetwork(&cfg, branches, threads);
+    return EXIT_SUCCESS;
+  }
+  if(slaMinutes > 0) {
+    optimizeStaff(&cfg, slaMinutes, threads);
+    return EXIT_SUCCESS;
+  }
+  if(replications > 0) {
+    runReplications(&cfg, replications, threads);
+    return EXIT_SUCCESS;
+  }
+
+  bank.cfg = cfg;
+  if(tracePath != NULL) {
+    bank.trace = traceOpen(tracePath);
+    if(bank.trace == NULL) return EXIT_FAILURE;
+  }
+  if(metricsName != NULL) {
+    if(eventMode) {
+      fprintf(stderr, "Live metrics only follow the real time threaded bank\n");
+      return EXIT_FAILURE;
+    }
+    bank.metrics = metricsOpen(metricsName, cfg.tellers);
+    if(bank.metrics == NULL) return EXIT_FAILURE;
+  }
+  if(checkpoint.path != NULL) {
+    if(eventMode != 1) {
+      fprintf(stderr, "Only the event engine (-d) can checkpoint\n");
+      return EXIT_FAILURE;
+    }
+    bank.checkpoint = &checkpoint;
+  }
+  start = nowNanos();
+  if(eventMode == 2) {
+    if(cfg.discipline != DISC_SHARED) {
+      fprintf(stderr, "Coroutine engine only models the shared line\n");
+      return EXIT_FAILURE;
+    }
+    runCoroutines(&bank);
+  } else if(resumePath != NULL) {
+    if(!snapshotLoad(&bank, &day, resumePath)) return EXIT_FAILURE;
+    runEventDay(&bank, &day);
+  } else if(eventMode) {
+    runEvents(&bank);
+  } else {
+    openBank(&bank);
+    closeBank(&bank);
+    metricsClose(bank.metrics, metricsName);
+  }
+  elapsed = nowNanos() - start;
+  getrusage(RUSAGE_SELF, &usage);
+  if(bank.trace != NULL) {
+    traced = traceClose(bank.trace);
+    printf("Traced %llu events to %s\n", (unsigned long long)traced, tracePath);
+  }
+  if(checkpoint.path != NULL) {
+    printf("Checkpointed %d times to %s every %d secs\n", checkpoint.written, checkpoint.path, checkpoint.every);
+    free(checkpoint.buf.data);
+  }
+  stats(&bank);
+  poolRelease(&bank.pool);
+  printf("Simulated %d secs in %.3f ms\n", bank.clock.secs, elapsed / 1e6);
+  printf("Context switches: %ld voluntary, %ld involuntary\n", usage.ru_nvcsw, usage.ru_nivcsw);
+  if(!eventMode) clockStats(&bank.clock);
+  bankFree(&bank);
   printf("DONE\n");
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,113 @@
+// Live metrics shared memory layout, shared by Project4.c and tools/bankmon.c
+//
+// The simulator creates a POSIX shared memory object (-m name) holding one
+// MetricsSegment. Every slot has exactly one writer thread which brackets its
+// updates with metricsBegin/metricsEnd; readers copy a slot out with
+// metricsRead, which retries until it sees a copy no writer was inside of.
+// Writers never wait on readers, so any number of monitors can poll at any rate.
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define METRICS_MAGIC 0x435254454D4B4E42ULL // "BNKMETRC" little endian
+#define METRICS_VERSION 1
+#define METRICS_TELLERS 256 // Tellers published, later ones are left out
+#define METRICS_SUB_BITS 3
+#define METRICS_SUB (1 << METRICS_SUB_BITS) // Linear sub-buckets per power of two (~12% resolution)
+#define METRICS_BUCKETS ((32 - METRICS_SUB_BITS + 1) * METRICS_SUB) // Enough for any non-negative int
+#define METRICS_ALIGNED __attribute__((aligned(64))) // Slot on its own cache line
+
+// What a teller is doing
+typedef enum MetricsState{
+  MS_IDLE = 0, // Waiting for a customer
+  MS_BUSY, // Serving custId
+  MS_DONE // Gone home
+}MetricsState;
+
+// Written by the clock thread every tick
+typedef struct MetricsClock{
+  uint32_t seq; // Odd while being written
+  int32_t secs; // Simulated second
+  int32_t closeTime; // Simulated second the doors close
+  int32_t pad;
+  uint64_t ticks; // Real periods elapsed
+  uint64_t missed; // Wakeups that covered more than one period
+}METRICS_ALIGNED MetricsClock;
+
+// Written by the customer generator on every arrival
+typedef struct MetricsGen{
+  uint32_t seq;
+  int32_t arrivals; // Customers in the door so far
+  int32_t lastDepth; // Line length the latest arrival joined at
+  int32_t maxDepth; // Longest line any arrival joined
+}METRICS_ALIGNED MetricsGen;
+
+// Written by one teller as it takes and finishes customers
+// Line length now is MetricsGen.arrivals minus every teller's started
+typedef struct MetricsTeller{
+  uint32_t seq;
+  int32_t state; // MetricsState
+  int32_t custId; // Customer being served, -1 if none
+  int32_t started; // Customers taken from the line
+  int32_t served; // Customers finished
+  int32_t maxWait; // Longest customer wait seen
+  int64_t waitSum; // Customer wait total, simulated seconds
+  uint32_t wait[METRICS_BUCKETS]; // Customer wait histogram, see metricsBucket()
+}METRICS_ALIGNED MetricsTeller;
+
+// Whole shared object
+typedef struct MetricsSegment{
+  uint64_t magic; // METRICS_MAGIC, stored last once the segment is ready
+  uint32_t version; // METRICS_VERSION
+  uint32_t size; // sizeof(MetricsSegment)
+  int32_t tellers; // Teller slots in use
+  int32_t pid; // Simulator process
+  int32_t done; // Boolean set once the day is over and nothing will change
+  MetricsClock clock;
+  MetricsGen gen;
+  MetricsTeller teller[METRICS_TELLERS];
+}MetricsSegment;
+
+// Histogram bucket holding value, log2 with METRICS_SUB linear steps
+static inline int metricsBucket(int value) {
+  int shift = 0;
+  if(value < METRICS_SUB) return value < 0 ? 0 : value;
+  while((value >> shift) >= 2 * METRICS_SUB) shift++;
+  return (shift + 1) * METRICS_SUB + (value >> shift) - METRICS_SUB;
+}
+
+// Largest value that lands in bucket
+static inline int metricsBucketTop(int bucket) {
+  int shift;
+  if(bucket < METRICS_SUB) return bucket;
+  shift = bucket / METRICS_SUB - 1;
+  return (int)((((long long)(bucket % METRICS_SUB + METRICS_SUB) + 1) << shift) - 1);
+}
+
+// Writer is about to change the slot guarded by seq
+static inline void metricsBegin(uint32_t* seq) {
+  __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE); // Odd seq is visible before any field changes
+}
+
+// Writer has finished changing the slot guarded by seq
+static inline void metricsEnd(uint32_t* seq) {
+  __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+// Copy a slot starting with its seq into dst, retrying while a writer is in it
+static inline void metricsRead(void* dst, const void* slot, size_t bytes) {
+  const uint32_t* seq = (const uint32_t*)slot;
+  uint32_t before;
+  uint32_t after;
+  do {
+    before = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+    memcpy(dst, slot, bytes);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE); // Copy finishes before seq is rechecked
+    after = __atomic_load_n(seq, __ATOMIC_RELAXED);
+  } while((before & 1) || before != after);
+}
+
+#endif
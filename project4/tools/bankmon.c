@@ -0,0 +1,155 @@
+// Live monitor for a running Project4 bank (-m shm_name)
+// Build: cc -O2 -Wall -o bankmon project4/tools/bankmon.c (add -lrt on older glibc)
+// Usage: bankmon [-i interval_ms] [-t] shm_name
+//   prints one line per interval until the day is over
+//   -t adds each teller's state, customer and served count
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "../metrics.h"
+
+// Consistent copy of every slot, taken one slot at a time
+typedef struct Snapshot{
+  MetricsClock clock;
+  MetricsGen gen;
+  MetricsTeller teller[METRICS_TELLERS];
+  uint32_t wait[METRICS_BUCKETS]; // All tellers' wait histograms merged
+  long waits; // Samples in wait
+  int maxWait;
+}Snapshot;
+
+static const char stateChars[] = "IBD"; // Indexed by MetricsState
+
+// Copy every slot out of the segment and merge the wait histograms
+void snapshot(const MetricsSegment* m, int tellers, Snapshot* snap) {
+  int i;
+  int j;
+  metricsRead(&snap->clock, &m->clock, sizeof(MetricsClock));
+  metricsRead(&snap->gen, &m->gen, sizeof(MetricsGen));
+  memset(snap->wait, 0, sizeof(snap->wait));
+  snap->waits = 0;
+  snap->maxWait = 0;
+  for(i = 0; i < tellers; i++) {
+    metricsRead(&snap->teller[i], &m->teller[i], sizeof(MetricsTeller));
+    for(j = 0; j < METRICS_BUCKETS; j++) snap->wait[j] += snap->teller[i].wait[j];
+    snap->waits += snap->teller[i].started;
+    if(snap->teller[i].maxWait > snap->maxWait) snap->maxWait = snap->teller[i].maxWait;
+  }
+}
+
+// Wait at percentile pct (0-100) of the merged histogram, accurate to the bucket width
+int waitPercentile(Snapshot* snap, double pct) {
+  long rank = (long)(snap->waits * pct / 100.0 + 0.5);
+  long seen = 0;
+  int i;
+  if(snap->waits == 0) return 0;
+  if(rank < 1) rank = 1;
+  for(i = 0; i < METRICS_BUCKETS; i++) {
+    seen += snap->wait[i];
+    if(seen >= rank) {
+      return metricsBucketTop(i) < snap->maxWait ? metricsBucketTop(i) : snap->maxWait;
+    }
+  }
+  return snap->maxWait;
+}
+
+// One status line, plus the tellers if asked
+void report(Snapshot* snap, int tellers, int showTellers) {
+  long started = 0;
+  long served = 0;
+  long waitSum = 0;
+  int busy = 0;
+  int depth;
+  int i;
+  for(i = 0; i < tellers; i++) {
+    started += snap->teller[i].started;
+    served += snap->teller[i].served;
+    waitSum += snap->teller[i].waitSum;
+    busy += snap->teller[i].state == MS_BUSY;
+  }
+  // Slots are read one after another, so a customer can be seen taken before arriving
+  depth = snap->gen.arrivals - (int)started;
+  if(depth < 0) depth = 0;
+  printf("%7d/%-7d %8d %6d %6d %7ld %5d/%-5d %8.1f %6d %6d %6d %7llu\n",
+    snap->clock.secs, snap->clock.closeTime, snap->gen.arrivals, depth, snap->gen.maxDepth,
+    served, busy, tellers, snap->waits ? (double)waitSum / snap->waits : 0.0,
+    waitPercentile(snap, 50), waitPercentile(snap, 90), waitPercentile(snap, 99),
+    (unsigned long long)snap->clock.missed);
+  if(!showTellers) return;
+  for(i = 0; i < tellers; i++) {
+    printf("  teller %3d %c cust %6d served %6d\n", i,
+      snap->teller[i].state <= MS_DONE ? stateChars[snap->teller[i].state] : '?',
+      snap->teller[i].custId, snap->teller[i].served);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  long intervalMs = 100;
+  int showTellers = 0;
+  int opt;
+  int fd;
+  int tellers;
+  int done;
+  MetricsSegment* m;
+  Snapshot* snap;
+  struct timespec interval;
+
+  while((opt = getopt(argc, argv, "i:t")) != -1) {
+    if(opt == 'i' && atol(optarg) > 0) {
+      intervalMs = atol(optarg);
+    } else if(opt == 't') {
+      showTellers = 1;
+    } else {
+      fprintf(stderr, "Usage: %s [-i interval_ms] [-t] shm_name\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if(optind != argc - 1) {
+    fprintf(stderr, "Usage: %s [-i interval_ms] [-t] shm_name\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  fd = shm_open(argv[optind], O_RDONLY, 0);
+  if(fd < 0) {
+    perror(argv[optind]);
+    return EXIT_FAILURE;
+  }
+  m = (MetricsSegment*)mmap(NULL, sizeof(MetricsSegment), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(m == MAP_FAILED) {
+    perror("mmap");
+    return EXIT_FAILURE;
+  }
+  if(__atomic_load_n(&m->magic, __ATOMIC_ACQUIRE) != METRICS_MAGIC || m->version != METRICS_VERSION
+      || m->size != sizeof(MetricsSegment)) {
+    fprintf(stderr, "%s: not a version %d metrics segment\n", argv[optind], METRICS_VERSION);
+    return EXIT_FAILURE;
+  }
+  tellers = m->tellers;
+  snap = (Snapshot*)malloc(sizeof(Snapshot));
+  if(snap == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("Watching pid %d, %d tellers\n", m->pid, tellers);
+  printf("%15s %8s %6s %6s %7s %11s %8s %6s %6s %6s %7s\n", "secs", "arrived", "line", "max",
+    "served", "busy", "avg wait", "p50", "p90", "p99", "missed");
+  interval.tv_sec = intervalMs / 1000;
+  interval.tv_nsec = (intervalMs % 1000) * 1000000L;
+  do {
+    done = __atomic_load_n(&m->done, __ATOMIC_ACQUIRE); // Read before the slots so the last line is final
+    snapshot(m, tellers, snap);
+    report(snap, tellers, showTellers);
+    fflush(stdout);
+    if(!done) nanosleep(&interval, NULL);
+  } while(!done);
+
+  free(snap);
+  munmap(m, sizeof(MetricsSegment));
+  return EXIT_SUCCESS;
+}
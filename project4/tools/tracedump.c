@@ -0,0 +1,210 @@
+// Offline decoder for Project4 event traces (-o tracefile)
+// Build: cc -O2 -Wall -o tracedump project4/tools/tracedump.c
+// Usage: tracedump [-r] tracefile
+//   default prints one timeline line per customer and a per-teller summary
+//   -r prints every record in time order instead
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../trace.h"
+
+// Everything recorded about one customer, -1 where no record was seen
+typedef struct Timeline{
+  int arrive;
+  int transTime;
+  int depth;
+  int start;
+  int teller;
+  int wait;
+  int end;
+}Timeline;
+
+// Per-teller totals
+typedef struct TellerSummary{
+  int served;
+  int idles;
+}TellerSummary;
+
+static const char* typeNames[TR_TYPES] = {
+  "arrival", "enqueue", "service_start", "service_end", "teller_idle"
+};
+
+// Order records by cycle counter, ties by simulated second
+int byTsc(const void* a, const void* b) {
+  const TraceRecord* x = *(const TraceRecord* const*)a;
+  const TraceRecord* y = *(const TraceRecord* const*)b;
+  if(x->tsc != y->tsc) return x->tsc < y->tsc ? -1 : 1;
+  return x->secs - y->secs;
+}
+
+// Print a field, or - if it was never recorded
+void field(int value) {
+  if(value < 0) printf("%8s", "-");
+  else printf("%8d", value);
+}
+
+// Every record in time order, with microseconds since trace start
+void dumpRecords(const TraceHeader* header, TraceRecord** sorted, uint64_t n) {
+  double nsPerTick = 1.0;
+  uint64_t i;
+  if(header->tscEnd > header->tscStart) {
+    nsPerTick = (double)(header->nsEnd - header->nsStart) / (header->tscEnd - header->tscStart);
+  }
+  printf("%14s %8s %7s %-14s %8s %8s\n", "us", "secs", "source", "type", "cust", "arg");
+  for(i = 0; i < n; i++) {
+    printf("%14.3f %8d %7u %-14s %8d %8d\n",
+      (sorted[i]->tsc - header->tscStart) * nsPerTick / 1000.0, sorted[i]->secs,
+      sorted[i]->source, sorted[i]->type < TR_TYPES ? typeNames[sorted[i]->type] : "?",
+      sorted[i]->custId, sorted[i]->arg);
+  }
+}
+
+// One line per customer plus per-teller totals
+void dumpTimelines(TraceRecord** sorted, uint64_t n) {
+  Timeline* lines;
+  TellerSummary* tellers;
+  int maxId = 0;
+  int maxSource = 0;
+  int id;
+  uint64_t i;
+  TraceRecord* rec;
+
+  for(i = 0; i < n; i++) {
+    if(sorted[i]->custId > maxId) maxId = sorted[i]->custId;
+    if(sorted[i]->source > maxSource) maxSource = sorted[i]->source;
+  }
+  lines = (Timeline*)malloc((maxId + 1) * sizeof(Timeline));
+  tellers = (TellerSummary*)calloc(maxSource + 1, sizeof(TellerSummary));
+  if(lines == NULL || tellers == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  memset(lines, 0xff, (maxId + 1) * sizeof(Timeline)); // Every field -1
+
+  for(i = 0; i < n; i++) {
+    rec = sorted[i];
+    if(rec->type == TR_TELLER_IDLE) {
+      tellers[rec->source].idles++;
+      continue;
+    }
+    if(rec->custId < 0) continue;
+    switch(rec->type) {
+      case TR_ARRIVAL:
+        lines[rec->custId].arrive = rec->secs;
+        lines[rec->custId].transTime = rec->arg;
+        break;
+      case TR_ENQUEUE:
+        lines[rec->custId].depth = rec->arg;
+        break;
+      case TR_SERVICE_START:
+        lines[rec->custId].start = rec->secs;
+        lines[rec->custId].teller = rec->source - 1;
+        lines[rec->custId].wait = rec->arg;
+        break;
+      case TR_SERVICE_END:
+        lines[rec->custId].end = rec->secs;
+        tellers[rec->source].served++;
+        break;
+    }
+  }
+
+  printf("%8s%8s%8s%8s%8s%8s%8s%8s\n", "cust", "arrive", "depth", "teller", "start", "wait", "trans", "end");
+  for(id = 1; id <= maxId; id++) {
+    printf("%8d", id);
+    field(lines[id].arrive);
+    field(lines[id].depth);
+    field(lines[id].teller);
+    field(lines[id].start);
+    field(lines[id].wait);
+    field(lines[id].transTime);
+    field(lines[id].end);
+    printf("\n");
+  }
+  for(id = 1; id <= maxSource; id++) {
+    printf("Teller %d: served %d customers, went idle %d times\n", id - 1,
+      tellers[id].served, tellers[id].idles);
+  }
+  free(lines);
+  free(tellers);
+}
+
+int main(int argc, char* argv[]) {
+  int raw = 0;
+  int opt;
+  int fd;
+  struct stat st;
+  char* map;
+  TraceHeader* header;
+  TraceRecord* recs;
+  TraceRecord** sorted;
+  uint64_t n;
+  uint64_t i;
+
+  while((opt = getopt(argc, argv, "r")) != -1) {
+    if(opt == 'r') {
+      raw = 1;
+    } else {
+      fprintf(stderr, "Usage: %s [-r] tracefile\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if(optind != argc - 1) {
+    fprintf(stderr, "Usage: %s [-r] tracefile\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  fd = open(argv[optind], O_RDONLY);
+  if(fd < 0 || fstat(fd, &st) != 0) {
+    perror(argv[optind]);
+    return EXIT_FAILURE;
+  }
+  if(st.st_size < TRACE_DATA_OFFSET) {
+    fprintf(stderr, "%s: too short for a trace\n", argv[optind]);
+    return EXIT_FAILURE;
+  }
+  map = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(map == MAP_FAILED) {
+    perror("mmap");
+    return EXIT_FAILURE;
+  }
+  header = (TraceHeader*)map;
+  if(header->magic != TRACE_MAGIC || header->version != TRACE_VERSION
+      || header->recordSize != sizeof(TraceRecord)) {
+    fprintf(stderr, "%s: not a version %d trace\n", argv[optind], TRACE_VERSION);
+    return EXIT_FAILURE;
+  }
+  recs = (TraceRecord*)(map + TRACE_DATA_OFFSET);
+  n = header->records;
+  if(n > (st.st_size - TRACE_DATA_OFFSET) / sizeof(TraceRecord)) {
+    n = (st.st_size - TRACE_DATA_OFFSET) / sizeof(TraceRecord); // Truncated file
+  }
+
+  printf("%llu records from %u threads, %llu dropped, %.3f ms",
+    (unsigned long long)n, header->writers, (unsigned long long)header->dropped,
+    (header->nsEnd - header->nsStart) / 1e6);
+  if(header->nsEnd > header->nsStart) {
+    printf(", %.3f counter ticks/ns", (double)(header->tscEnd - header->tscStart) / (header->nsEnd - header->nsStart));
+  }
+  printf("\n");
+
+  // Records are grouped by writer in the file, sort pointers into one timeline
+  sorted = (TraceRecord**)malloc(n * sizeof(TraceRecord*) + 1);
+  if(sorted == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return EXIT_FAILURE;
+  }
+  for(i = 0; i < n; i++) sorted[i] = &recs[i];
+  qsort(sorted, n, sizeof(TraceRecord*), byTsc);
+
+  if(raw) dumpRecords(header, sorted, n);
+  else dumpTimelines(sorted, n);
+
+  free(sorted);
+  munmap(map, st.st_size);
+  close(fd);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,51 @@
+// Binary event trace file format, shared by Project4.c and tools/tracedump.c
+//
+// Layout: one TRACE_DATA_OFFSET byte page holding TraceHeader, then
+// TraceHeader.records fixed size TraceRecords. Records are grouped by the
+// writer thread that drained them, sort by tsc for a global timeline.
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_MAGIC 0x45434152544B4E42ULL // "BNKTRACE" little endian
+#define TRACE_VERSION 1
+#define TRACE_DATA_OFFSET 4096 // Records start on the second page
+
+// What a record describes
+typedef enum TraceType{
+  TR_ARRIVAL = 0, // Customer entered the bank, arg is their transaction time
+  TR_ENQUEUE, // Customer joined a line, arg is depth they saw
+  TR_SERVICE_START, // Teller began serving customer, arg is customer wait
+  TR_SERVICE_END, // Teller finished with customer, arg is transaction time
+  TR_TELLER_IDLE, // Teller started waiting for a customer, custId is -1
+  TR_TYPES
+}TraceType;
+
+// Fixed size record, written by exactly one thread
+typedef struct TraceRecord{
+  uint64_t tsc; // Cycle counter (ClockCycles on QNX, rdtsc on x86, else ns)
+  int32_t secs; // Simulated second
+  uint16_t type; // TraceType
+  uint16_t source; // 0 for the customer generator, 1 + index for a teller
+  int32_t custId; // Customer id, -1 if none
+  int32_t arg; // Depends on type
+}TraceRecord;
+
+// File header, rewritten when the trace is closed
+// tsc to wall time is (tsc - tscStart) * (nsEnd - nsStart) / (tscEnd - tscStart)
+typedef struct TraceHeader{
+  uint64_t magic; // TRACE_MAGIC
+  uint32_t version; // TRACE_VERSION
+  uint32_t recordSize; // sizeof(TraceRecord)
+  uint64_t records; // Records in file
+  uint64_t dropped; // Records lost to full rings
+  uint64_t tscStart; // Cycle counter when trace opened
+  uint64_t nsStart; // Monotonic ns when trace opened
+  uint64_t tscEnd; // Cycle counter when trace closed
+  uint64_t nsEnd; // Monotonic ns when trace closed
+  uint32_t writers; // Threads that recorded into the trace
+  uint32_t pad;
+}TraceHeader;
+
+#endif